@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/quickpool_test.dir/test.cpp.o"
+  "CMakeFiles/quickpool_test.dir/test.cpp.o.d"
+  "quickpool_test"
+  "quickpool_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/quickpool_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
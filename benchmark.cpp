@@ -5,12 +5,15 @@
 #include <chrono>
 #include <cstdint>
 #include <cstdlib>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <list>
 #include <limits>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -33,6 +36,7 @@ struct Workload
     int nested_outer;
     int nested_inner;
     int list_items;
+    int matrix_size;
 };
 
 void
@@ -88,9 +92,9 @@ Workload
 workload_for(const Options& options)
 {
     if (options.quick) {
-        return Workload{ 1000, 3, 100, 4000, 40, 40, 2000 };
+        return Workload{ 1000, 3, 100, 4000, 40, 40, 2000, 128 };
     }
-    return Workload{ 10000, 3, 1000, 100000, 200, 200, 50000 };
+    return Workload{ 10000, 3, 1000, 100000, 200, 200, 50000, 2048 };
 }
 
 std::vector<size_t>
@@ -122,13 +126,14 @@ burn(size_t rounds, std::uint64_t seed)
     return x;
 }
 
-template<class Function>
+template<class Setup, class Function>
 double
-median_ms(int repetitions, Function f)
+median_ms(int repetitions, Setup setup, Function f)
 {
     std::vector<double> timings;
     timings.reserve(static_cast<size_t>(repetitions));
     for (int rep = 0; rep < repetitions; ++rep) {
+        setup();
         const auto start = std::chrono::steady_clock::now();
         f();
         const auto stop = std::chrono::steady_clock::now();
@@ -143,6 +148,13 @@ median_ms(int repetitions, Function f)
     return (timings[middle - 1] + timings[middle]) / 2.0;
 }
 
+template<class Function>
+double
+median_ms(int repetitions, Function f)
+{
+    return median_ms(repetitions, [] {}, f);
+}
+
 void
 print_result(const std::string& name,
              size_t threads,
@@ -173,6 +185,114 @@ benchmark_push_empty(size_t threads, int tasks, int repetitions)
     print_result("push_empty", threads, tasks, repetitions, median);
 }
 
+void
+benchmark_push_n_empty(size_t threads, int tasks, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    const auto median = median_ms(repetitions, [&] {
+        std::atomic<int> done{ 0 };
+        pool.push_n(static_cast<size_t>(tasks), [&](size_t) {
+            done.fetch_add(1, std::memory_order_relaxed);
+        });
+        pool.wait();
+        if (done.load(std::memory_order_relaxed) != tasks) {
+            throw std::runtime_error("push_n_empty lost work");
+        }
+    });
+    print_result("push_n_empty", threads, tasks, repetitions, median);
+}
+
+void
+benchmark_push_producers(size_t threads, int tasks, int repetitions)
+{
+    // Several threads outside the pool push concurrently.
+    const int producers = 8;
+    quickpool::ThreadPool pool(threads);
+    const auto median = median_ms(repetitions, [&] {
+        std::atomic<int> done{ 0 };
+        std::vector<std::thread> pushers;
+        for (int p = 0; p < producers; ++p) {
+            pushers.emplace_back([&, p] {
+                for (int i = p; i < tasks; i += producers) {
+                    pool.push(
+                      [&] { done.fetch_add(1, std::memory_order_relaxed); });
+                }
+            });
+        }
+        for (auto& pusher : pushers) {
+            pusher.join();
+        }
+        pool.wait();
+        if (done.load(std::memory_order_relaxed) != tasks) {
+            throw std::runtime_error("push_producers lost work");
+        }
+    });
+    print_result("push_producers", threads, tasks, repetitions, median);
+}
+
+void
+benchmark_push_latency(const std::string& name,
+                       quickpool::IdlePolicy policy,
+                       size_t threads,
+                       int samples)
+{
+    // Time from pushing a single task until it starts, after the workers
+    // had a break. Spinning workers only help if the break is shorter than
+    // their spin window (a few microseconds), so the break is swept.
+    quickpool::ThreadPool pool(threads, policy);
+    std::atomic_bool started{ false };
+    for (int gap_us : { 0, 5, 50 }) {
+        const auto median = median_ms(
+          samples,
+          [&] {
+              started.store(false, std::memory_order_relaxed);
+              // sleep_for() may oversleep by tens of microseconds.
+              const auto until = std::chrono::steady_clock::now() +
+                                 std::chrono::microseconds(gap_us);
+              while (std::chrono::steady_clock::now() < until) {
+              }
+          },
+          [&] {
+              pool.push(
+                [&] { started.store(true, std::memory_order_release); });
+              while (!started.load(std::memory_order_acquire)) {
+              }
+          });
+        pool.wait();
+        print_result(name + "_" + std::to_string(gap_us) + "us",
+                     threads,
+                     1,
+                     samples,
+                     median);
+    }
+}
+
+void
+benchmark_push_nested(size_t threads, int tasks, int repetitions)
+{
+    // Every task pushes its two children from inside a worker, a binary tree
+    // with `tasks` nodes.
+    quickpool::ThreadPool pool(threads);
+    std::atomic<int> done{ 0 };
+    std::function<void(int)> spawn = [&](int node) {
+        done.fetch_add(1, std::memory_order_relaxed);
+        for (int child = 2 * node + 1; child <= 2 * node + 2; ++child) {
+            if (child < tasks) {
+                pool.push([&spawn, child] { spawn(child); });
+            }
+        }
+    };
+    const auto median = median_ms(repetitions, [&] {
+        done = 0;
+        pool.push([&] { spawn(0); });
+        pool.wait();
+        if (done.load(std::memory_order_relaxed) != tasks) {
+            throw std::runtime_error("push_nested lost work");
+        }
+    });
+    print_result("push_nested", threads, tasks, repetitions, median);
+}
+
 void
 benchmark_push_medium(size_t threads, int tasks, int repetitions)
 {
@@ -193,6 +313,38 @@ benchmark_push_medium(size_t threads, int tasks, int repetitions)
     print_result("push_medium", threads, tasks, repetitions, median);
 }
 
+void
+benchmark_async(size_t threads, int tasks, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::vector<std::future<int>> futures(static_cast<size_t>(tasks));
+    const auto median = median_ms(repetitions, [&] {
+        for (auto& future : futures) {
+            future = pool.async([] { return 1; });
+        }
+        for (auto& future : futures) {
+            sink += static_cast<std::uint64_t>(future.get());
+        }
+    });
+    print_result("async", threads, tasks, repetitions, median);
+}
+
+void
+benchmark_submit(size_t threads, int tasks, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::vector<quickpool::Future<int>> futures(static_cast<size_t>(tasks));
+    const auto median = median_ms(repetitions, [&] {
+        for (auto& future : futures) {
+            future = pool.submit([] { return 1; });
+        }
+        for (auto& future : futures) {
+            sink += static_cast<std::uint64_t>(future.get());
+        }
+    });
+    print_result("submit", threads, tasks, repetitions, median);
+}
+
 void
 benchmark_parallel_for_short(size_t threads,
                              int items,
@@ -232,6 +384,106 @@ benchmark_parallel_for_tiny(size_t threads, int items, int repetitions)
     print_result("parallel_for_tiny", threads, items, repetitions, median);
 }
 
+void
+benchmark_for_tiny_serial(size_t threads, int items, int repetitions)
+{
+    std::vector<std::uint64_t> output(static_cast<size_t>(items));
+    const auto median = median_ms(repetitions, [&] {
+        for (int i = 0; i < items; ++i) {
+            output[static_cast<size_t>(i)] = static_cast<std::uint64_t>(i) + 1;
+        }
+    });
+    for (auto value : output) {
+        sink ^= value;
+    }
+    print_result("for_tiny_serial", threads, items, repetitions, median);
+}
+
+void
+benchmark_parallel_for_tiny_adaptive(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    quickpool::AdaptivePartitioner partitioner;
+    std::vector<std::uint64_t> output(static_cast<size_t>(items));
+    const auto median = median_ms(repetitions, [&] {
+        pool.parallel_for(
+          0,
+          items,
+          [&](int i) {
+              output[static_cast<size_t>(i)] =
+                static_cast<std::uint64_t>(i) + 1;
+          },
+          partitioner);
+    });
+    for (auto value : output) {
+        sink ^= value;
+    }
+    print_result(
+      "parallel_for_tiny_adaptive", threads, items, repetitions, median);
+}
+
+template<class Index>
+void
+benchmark_parallel_for_tiny_index(const std::string& name,
+                                  size_t threads,
+                                  int items,
+                                  int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::vector<std::uint64_t> output(static_cast<size_t>(items));
+    const auto median = median_ms(repetitions, [&] {
+        pool.parallel_for(Index(0), static_cast<Index>(items), [&](Index i) {
+            output[static_cast<size_t>(i)] = static_cast<std::uint64_t>(i) + 1;
+        });
+    });
+    for (auto value : output) {
+        sink ^= value;
+    }
+    print_result(name, threads, items, repetitions, median);
+}
+
+void
+benchmark_parallel_for_tiny_chunked(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::vector<std::uint64_t> output(static_cast<size_t>(items));
+    const auto median = median_ms(repetitions, [&] {
+        pool.parallel_for(
+          0,
+          items,
+          [&](int i) {
+              output[static_cast<size_t>(i)] =
+                static_cast<std::uint64_t>(i) + 1;
+          },
+          0);
+    });
+    for (auto value : output) {
+        sink ^= value;
+    }
+    print_result(
+      "parallel_for_tiny_chunked", threads, items, repetitions, median);
+}
+
+void
+benchmark_parallel_for_range_tiny(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::vector<std::uint64_t> output(static_cast<size_t>(items));
+    const auto median = median_ms(repetitions, [&] {
+        pool.parallel_for_range(0, items, [&](int b, int e) {
+            for (auto i = b; i < e; ++i) {
+                output[static_cast<size_t>(i)] =
+                  static_cast<std::uint64_t>(i) + 1;
+            }
+        });
+    });
+    for (auto value : output) {
+        sink ^= value;
+    }
+    print_result(
+      "parallel_for_range_tiny", threads, items, repetitions, median);
+}
+
 void
 benchmark_parallel_for_medium(size_t threads, int items, int repetitions)
 {
@@ -267,6 +519,31 @@ benchmark_parallel_for_uneven(size_t threads, int items, int repetitions)
     print_result("parallel_for_uneven", threads, items, repetitions, median);
 }
 
+// All work sits in the range of the last loop worker, so the loop's run time
+// is dominated by how fast idle workers find and split that range.
+void
+benchmark_parallel_for_tail(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::vector<std::uint64_t> output(static_cast<size_t>(items));
+    const auto heavy = items - items / static_cast<int>(threads + 1);
+    const auto median = median_ms(repetitions, [&] {
+        pool.parallel_for(
+          0,
+          items,
+          [&](int i) {
+              const auto idx = static_cast<size_t>(i);
+              output[idx] =
+                burn(i < heavy ? 1 : 256, static_cast<std::uint64_t>(idx));
+          },
+          1);
+    });
+    for (auto value : output) {
+        sink ^= value;
+    }
+    print_result("parallel_for_tail", threads, items, repetitions, median);
+}
+
 void
 benchmark_parallel_for_nested(size_t threads,
                               int outer,
@@ -290,6 +567,258 @@ benchmark_parallel_for_nested(size_t threads,
     print_result("parallel_for_nested", threads, items, repetitions, median);
 }
 
+// Recursive divide-and-conquer: every call splits its range in halves until
+// 64 items are left.
+void
+benchmark_fork_join(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::vector<std::uint64_t> output(static_cast<size_t>(items));
+    std::function<void(int, int)> solve = [&](int begin, int end) {
+        if (end - begin <= 64) {
+            for (int i = begin; i < end; ++i) {
+                const auto idx = static_cast<size_t>(i);
+                output[idx] = burn(16, static_cast<std::uint64_t>(idx));
+            }
+            return;
+        }
+        const auto mid = begin + (end - begin) / 2;
+        pool.parallel_invoke([&] { solve(begin, mid); },
+                             [&] { solve(mid, end); });
+    };
+    const auto median = median_ms(repetitions, [&] { solve(0, items); });
+    for (auto value : output) {
+        sink ^= value;
+    }
+    print_result("fork_join", threads, items, repetitions, median);
+}
+
+void
+benchmark_task_graph(size_t threads, int items, int repetitions)
+{
+    // A stencil-like graph: every node processes 64 items and depends on two
+    // neighbors in the previous layer. It is built once and run repeatedly.
+    quickpool::ThreadPool pool(threads);
+    quickpool::TaskGraph graph(pool);
+    std::vector<std::uint64_t> output(static_cast<size_t>(items));
+    const size_t width = 16;
+    const size_t nodes = std::max(output.size() / 64, width);
+    for (size_t node = 0; node < nodes; ++node) {
+        graph.add([&, node] {
+            const auto begin = node * output.size() / nodes;
+            const auto end = (node + 1) * output.size() / nodes;
+            for (auto i = begin; i < end; ++i) {
+                output[i] = burn(16, static_cast<std::uint64_t>(i));
+            }
+        });
+        if (node >= width) {
+            const auto column = node % width;
+            graph.precede(node - width, node);
+            graph.precede(node - column + (column + 1) % width - width, node);
+        }
+    }
+    const auto median = median_ms(repetitions, [&] { graph.run(); });
+    for (auto value : output) {
+        sink ^= value;
+    }
+    print_result("task_graph", threads, items, repetitions, median);
+}
+
+void
+benchmark_repeated_sweeps(size_t threads,
+                          int items,
+                          int repetitions,
+                          bool affinity)
+{
+    quickpool::ThreadPool pool(threads);
+    quickpool::AffinityPartitioner partitioner(1024);
+    std::vector<double> x(static_cast<size_t>(items), 1.0);
+    auto sweep = [&](size_t b, size_t e) {
+        for (auto i = b; i < e; ++i) {
+            x[i] = 0.5 * x[i] + 1.0;
+        }
+    };
+    const auto median = median_ms(repetitions, [&] {
+        for (int sweeps = 0; sweeps < 10; ++sweeps) {
+            if (affinity) {
+                pool.parallel_for_range(
+                  size_t(0), x.size(), sweep, partitioner);
+            } else {
+                pool.parallel_for_range(size_t(0), x.size(), sweep, 1024);
+            }
+        }
+    });
+    sink ^= static_cast<std::uint64_t>(x.back());
+    print_result(affinity ? "repeated_sweeps_affinity" : "repeated_sweeps",
+                 threads,
+                 10 * items,
+                 repetitions,
+                 median);
+}
+
+void
+benchmark_transpose_rows(size_t threads, int n, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    const auto size = static_cast<size_t>(n);
+    std::vector<std::uint64_t> input(size * size, 1), output(size * size);
+    const auto median = median_ms(repetitions, [&] {
+        pool.parallel_for(size_t(0), size, [&](size_t i) {
+            for (size_t j = 0; j < size; ++j) {
+                output[j * size + i] = input[i * size + j];
+            }
+        });
+    });
+    sink ^= output.back();
+    print_result("transpose_rows", threads, n * n, repetitions, median);
+}
+
+void
+benchmark_transpose_tiled(size_t threads, int n, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    const auto size = static_cast<size_t>(n);
+    std::vector<std::uint64_t> input(size * size, 1), output(size * size);
+    const auto median = median_ms(repetitions, [&] {
+        pool.parallel_for_2d(
+          size, size, 32, [&](size_t rb, size_t re, size_t cb, size_t ce) {
+              for (auto i = rb; i < re; ++i) {
+                  for (auto j = cb; j < ce; ++j) {
+                      output[j * size + i] = input[i * size + j];
+                  }
+              }
+          });
+    });
+    sink ^= output.back();
+    print_result("transpose_tiled", threads, n * n, repetitions, median);
+}
+
+void
+benchmark_reduce_atomic(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::uint64_t result = 0;
+    const auto median = median_ms(repetitions, [&] {
+        std::atomic<std::uint64_t> total{ 0 };
+        pool.parallel_for(0, items, [&](int i) {
+            total.fetch_add(burn(4, static_cast<std::uint64_t>(i)),
+                            std::memory_order_relaxed);
+        });
+        result = total.load();
+    });
+    sink ^= result;
+    print_result("reduce_atomic", threads, items, repetitions, median);
+}
+
+void
+benchmark_parallel_reduce(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::uint64_t result = 0;
+    const auto median = median_ms(repetitions, [&] {
+        result = pool.parallel_reduce(
+          0,
+          items,
+          std::uint64_t(0),
+          [](int i) { return burn(4, static_cast<std::uint64_t>(i)); },
+          [](std::uint64_t a, std::uint64_t b) { return a + b; });
+    });
+    sink ^= result;
+    print_result("parallel_reduce", threads, items, repetitions, median);
+}
+
+void
+benchmark_inclusive_scan(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    std::vector<std::uint64_t> input(static_cast<size_t>(items));
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = burn(4, i);
+    }
+    std::vector<std::uint64_t> output(input.size());
+    const auto median = median_ms(repetitions, [&] {
+        pool.parallel_inclusive_scan(
+          input.begin(), input.end(), output.begin());
+    });
+    sink ^= output.back();
+    print_result("inclusive_scan", threads, items, repetitions, median);
+}
+
+std::vector<std::uint64_t>
+sort_input(int items)
+{
+    std::vector<std::uint64_t> input(static_cast<size_t>(items));
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = burn(4, i);
+    }
+    return input;
+}
+
+void
+benchmark_std_sort(int items, int repetitions)
+{
+    const auto input = sort_input(items);
+    std::vector<std::uint64_t> data;
+    const auto median = median_ms(
+      repetitions,
+      [&] { data = input; },
+      [&] { std::sort(data.begin(), data.end()); });
+    sink ^= data.back();
+    print_result("std_sort", 1, items, repetitions, median);
+}
+
+void
+benchmark_parallel_sort(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    const auto input = sort_input(items);
+    std::vector<std::uint64_t> data;
+    const auto median = median_ms(
+      repetitions,
+      [&] { data = input; },
+      [&] { pool.parallel_sort(data.begin(), data.end()); });
+    sink ^= data.back();
+    print_result("parallel_sort", threads, items, repetitions, median);
+}
+
+void
+benchmark_parallel_copy_if(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    const auto input = sort_input(items);
+    std::vector<std::uint64_t> output(input.size());
+    size_t count = 0;
+    const auto median = median_ms(repetitions, [&] {
+        const auto end = pool.parallel_copy_if(
+          input.begin(), input.end(), output.begin(), [](std::uint64_t x) {
+              return x % 3 == 0;
+          });
+        count = static_cast<size_t>(end - output.begin());
+    });
+    sink ^= count;
+    print_result("parallel_copy_if", threads, items, repetitions, median);
+}
+
+// The only match sits at a tenth of the range; a search that keeps scanning
+// after it takes about ten times as long.
+void
+benchmark_parallel_find_if(size_t threads, int items, int repetitions)
+{
+    quickpool::ThreadPool pool(threads);
+    const auto input = sort_input(items);
+    const auto target = input[input.size() / 10];
+    size_t pos = 0;
+    const auto median = median_ms(repetitions, [&] {
+        const auto it = pool.parallel_find_if(
+          input.begin(), input.end(), [target](std::uint64_t x) {
+              return x == target;
+          });
+        pos = static_cast<size_t>(it - input.begin());
+    });
+    sink ^= pos;
+    print_result("parallel_find_if", threads, items, repetitions, median);
+}
+
 void
 benchmark_for_each_vector(size_t threads, int items, int repetitions)
 {
@@ -337,23 +866,97 @@ main(int argc, char** argv)
               << ", quick=" << (options.quick ? "true" : "false") << '\n';
     std::cout << "name,threads,items,repetitions,median_ms,ns_per_item\n";
 
+    const auto sort_sizes = { workload.loop_items, 10 * workload.loop_items };
+    for (auto items : sort_sizes) {
+        benchmark_std_sort(items, options.repetitions);
+    }
+
     for (auto threads : counts) {
         benchmark_push_empty(threads, workload.push_tasks, options.repetitions);
+        benchmark_push_n_empty(
+          threads, workload.push_tasks, options.repetitions);
+        benchmark_push_nested(
+          threads, workload.push_tasks, options.repetitions);
+        benchmark_push_producers(
+          threads, workload.push_tasks, options.repetitions);
         benchmark_push_medium(threads, workload.push_tasks, options.repetitions);
+        if (threads > 0) {
+            const auto samples = workload.push_tasks / 10;
+            benchmark_push_latency("push_latency_block",
+                                   quickpool::IdlePolicy::block,
+                                   threads,
+                                   samples);
+            benchmark_push_latency("push_latency_spin",
+                                   quickpool::IdlePolicy::spin,
+                                   threads,
+                                   samples);
+        }
+        if (threads > 0 && threads < std::thread::hardware_concurrency()) {
+            // Polling workers need cores of their own.
+            benchmark_push_latency("push_latency_poll",
+                                   quickpool::IdlePolicy::poll,
+                                   threads,
+                                   workload.push_tasks / 10);
+        }
+        benchmark_async(threads, workload.push_tasks, options.repetitions);
+        benchmark_submit(threads, workload.push_tasks, options.repetitions);
         benchmark_parallel_for_short(threads,
                                      workload.short_loop_items,
                                      workload.short_loop_repeats,
                                      options.repetitions);
         benchmark_parallel_for_tiny(
           threads, workload.loop_items, options.repetitions);
+        benchmark_for_tiny_serial(
+          threads, workload.loop_items, options.repetitions);
+        benchmark_parallel_for_tiny_adaptive(
+          threads, workload.loop_items, options.repetitions);
+        benchmark_parallel_for_tiny_index<std::int64_t>(
+          "parallel_for_tiny_int64",
+          threads,
+          workload.loop_items,
+          options.repetitions);
+        benchmark_parallel_for_tiny_index<size_t>("parallel_for_tiny_size_t",
+                                                  threads,
+                                                  workload.loop_items,
+                                                  options.repetitions);
+        benchmark_parallel_for_tiny_chunked(
+          threads, workload.loop_items, options.repetitions);
+        benchmark_parallel_for_range_tiny(
+          threads, workload.loop_items, options.repetitions);
         benchmark_parallel_for_medium(
           threads, workload.loop_items, options.repetitions);
         benchmark_parallel_for_uneven(
           threads, workload.loop_items, options.repetitions);
+        benchmark_parallel_for_tail(
+          threads, workload.loop_items / 10, options.repetitions);
         benchmark_parallel_for_nested(threads,
                                       workload.nested_outer,
                                       workload.nested_inner,
                                       options.repetitions);
+        benchmark_fork_join(threads, workload.loop_items, options.repetitions);
+        benchmark_task_graph(
+          threads, workload.loop_items, options.repetitions);
+        benchmark_repeated_sweeps(
+          threads, workload.loop_items, options.repetitions, false);
+        benchmark_repeated_sweeps(
+          threads, workload.loop_items, options.repetitions, true);
+        benchmark_transpose_rows(
+          threads, workload.matrix_size, options.repetitions);
+        benchmark_transpose_tiled(
+          threads, workload.matrix_size, options.repetitions);
+        benchmark_reduce_atomic(
+          threads, workload.loop_items, options.repetitions);
+        benchmark_parallel_reduce(
+          threads, workload.loop_items, options.repetitions);
+        benchmark_inclusive_scan(
+          threads, workload.loop_items, options.repetitions);
+        for (auto items : sort_sizes) {
+            benchmark_parallel_sort(threads, items, options.repetitions);
+        }
+        benchmark_parallel_copy_if(
+          threads, workload.loop_items, options.repetitions);
+        benchmark_parallel_find_if(
+          threads, workload.loop_items, options.repetitions);
         benchmark_for_each_vector(
           threads, workload.loop_items, options.repetitions);
         benchmark_for_each_list(
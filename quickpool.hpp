@@ -21,8 +21,11 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <exception>
 #include <functional>
 #include <future>
@@ -30,6 +33,7 @@
 #include <limits>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <numeric>
 #include <stdexcept>
 #include <thread>
@@ -42,12 +46,39 @@
 #include <pthread.h>
 #endif
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#if (defined __linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
 #define QUICKPOOL_HAS_CPP17 1
 #else
 #define QUICKPOOL_HAS_CPP17 0
 #endif
 
+#if QUICKPOOL_HAS_CPP17 && defined(__cpp_impl_coroutine)
+#define QUICKPOOL_HAS_COROUTINES 1
+#include <coroutine>
+#include <optional>
+#else
+#define QUICKPOOL_HAS_COROUTINES 0
+#endif
+
+// GCC always routes 16-byte atomics through libatomic; only use them where the
+// compiler emits the instructions inline. Stays defined after this header, so
+// users can check whether loops may count more than 2^32 chunks.
+#if defined(__clang__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+#define QUICKPOOL_HAS_WIDE_CAS 1
+#else
+#define QUICKPOOL_HAS_WIDE_CAS 0
+#endif
+
 // Layout of quickpool.hpp
 //
 // 1. Memory related utilities.
@@ -57,12 +88,21 @@
 //    - Class for cache aligned atomics
 //    - Class for load/assign atomics with relaxed order
 // 2. Loop related utilities.
+//    - Chunks, blocks, and tiles of loop ranges
+//    - Learned cost of loop bodies
 //    - Worker class for parallel for loops
 // 3. Scheduling utilities.
 //    - Ring buffer
 //    - Task queue
+//    - Event count and idle policies for idle workers
+//    - Latch and recycled loop frames
 //    - Task manager
 // 4. Thread pool class
+//    - Affinity and adaptive partitioners for loops
+//    - Fork-join scopes, task groups, and task graphs
+//    - Futures with continuations
+//    - Coroutine tasks and awaitables (C++20)
+//    - Thread pool
 // 5. Free-standing functions (main API)
 
 //! quickpool namespace
@@ -70,6 +110,9 @@ namespace quickpool {
 
 namespace detail {
 
+//! ranges below this size are sorted serially.
+static constexpr size_t sort_cutoff = 1 << 13;
+
 template<class Function, class... Args>
 struct Task
 {
@@ -160,7 +203,7 @@ alloc(size_t alignment, size_t size) noexcept
 
     // Allocate enough space required for object and a void*.
     size_t space = size + alignment + sizeof(void*);
-    void* p = std::malloc(space);
+    void* p = ::operator new(space, std::nothrow);
     if (p == nullptr) {
         return nullptr;
     }
@@ -174,7 +217,7 @@ alloc(size_t alignment, size_t size) noexcept
 
     // Store unaligned pointer with offset sizeof(void*) before aligned
     // location. Later we'll know where to look for the pointer telling
-    // us where to free what we malloc()'ed above.
+    // us where to free what we allocated above.
     *(static_cast<void**>(p_algn) - 1) = p;
 
     return p_algn;
@@ -184,7 +227,7 @@ inline void
 free(void* ptr) noexcept
 {
     if (ptr) {
-        std::free(*(static_cast<void**>(ptr) - 1));
+        ::operator delete(*(static_cast<void**>(ptr) - 1));
     }
 }
 
@@ -292,6 +335,43 @@ struct relaxed_atomic : public mem::aligned::atomic<T>
     }
 };
 
+//! Object padded to fill whole cache lines, so that neighboring objects in
+//! an array never share a cache line.
+template<class T, size_t Align = 64>
+struct alignas(Align) padded
+{
+    T value;
+};
+
+//! Aligned, uninitialized storage for `size` objects of type `T`. Objects
+//! are constructed by the owner (possibly in parallel) and destroyed with the
+//! buffer once `constructed` is set.
+template<class T, size_t Alignment = 64>
+struct buffer
+{
+    explicit buffer(size_t size)
+      : data{ allocator<T, Alignment>().allocate(size) }
+      , size{ size }
+    {}
+
+    ~buffer()
+    {
+        if (constructed) {
+            for (size_t i = 0; i < size; ++i) {
+                data[i].~T();
+            }
+        }
+        allocator<T, Alignment>().deallocate(data, size);
+    }
+
+    buffer(const buffer&) = delete;
+    buffer& operator=(const buffer&) = delete;
+
+    T* data;
+    size_t size;
+    bool constructed{ false };
+};
+
 //! vector class for aligned types.
 template<class T, size_t Alignment = 64>
 using vector = std::vector<T, mem::aligned::allocator<T, Alignment>>;
@@ -305,45 +385,412 @@ using vector = std::vector<T, mem::aligned::allocator<T, Alignment>>;
 //! Loop related utilities.
 namespace loop {
 
-template<class Iterator, class UnaryFunction, class Pool>
-void
-parallel_for_each_impl(Iterator begin,
-                       Iterator end,
-                       int size,
-                       UnaryFunction f,
-                       Pool& pool,
-                       std::random_access_iterator_tag)
+//! common index type of a loop over `[begin, end)`; only defined for
+//! integral bounds.
+template<class Begin, class End>
+using index_t = typename std::enable_if<
+  std::is_integral<Begin>::value && std::is_integral<End>::value,
+  typename std::common_type<Begin, End>::type>::type;
+
+//! Hands out blocks of consecutive elements of an iterator range while
+//! walking it, so that ranges without random access can be processed in
+//! parallel without storing all iterators first. Blocks start with a single
+//! element and double up to `max_block` elements, so short ranges are still
+//! spread over threads and long ranges don't contend for the lock.
+template<class Iterator>
+class Stream
+{
+  public:
+    Stream(Iterator begin, Iterator end, size_t max_block = 64)
+      : pos_{ begin }
+      , end_{ end }
+      , max_block_{ max_block }
+    {}
+
+    //! claims the next block as `count` elements starting at `first`;
+    //! returns false when the range is exhausted or the stream stopped.
+    bool next(Iterator& first, size_t& count)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (stopped_ || pos_ == end_) {
+            return false;
+        }
+        first = pos_;
+        for (count = 0; count < block_ && pos_ != end_; ++count) {
+            ++pos_;
+        }
+        block_ = std::min(2 * block_, max_block_);
+        return true;
+    }
+
+    //! stops handing out blocks.
+    void stop()
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stopped_ = true;
+    }
+
+  private:
+    Iterator pos_;
+    Iterator end_;
+    size_t max_block_;
+    size_t block_{ 1 };
+    bool stopped_{ false };
+    std::mutex mtx_;
+};
+
+//! Chunks cancelled when a loop body returns `true`, see `call_body()`.
+enum class Cancel
+{
+    later, //!< all chunks after the current one
+    all    //!< all chunks
+};
+
+//! calls a loop body; returns whether it asks to cancel chunks. Bodies
+//! returning `void` never do.
+template<class Function, class... Args>
+auto
+call_body(Function& f, Args... args) -> typename std::enable_if<
+  std::is_void<decltype(f(args...))>::value,
+  bool>::type
 {
-    (void)end;
-    pool.parallel_for(0, static_cast<int>(size), [=](int i) { f(begin[i]); });
+    f(args...);
+    return false;
 }
 
-template<class Iterator, class UnaryFunction, class Pool, class IteratorCategory>
-void
-parallel_for_each_impl(Iterator begin,
-                       Iterator end,
-                       int size,
-                       UnaryFunction f,
-                       Pool& pool,
-                       IteratorCategory)
+template<class Function, class... Args>
+auto
+call_body(Function& f, Args... args) -> typename std::enable_if<
+  !std::is_void<decltype(f(args...))>::value,
+  bool>::type
+{
+    return static_cast<bool>(f(args...));
+}
+
+//! Splits an index range `[begin, end)` into chunks of `grain` indices.
+//!
+//! Index arithmetic is done on the unsigned counterpart of `Index`, so
+//! loops may span the full range of any integer type.
+template<typename Index>
+struct Chunks
+{
+    using Size = typename std::make_unsigned<Index>::type;
+
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param num_workers number of workers processing the loop.
+    //! @param grain_size requested chunk size; 0 selects one automatically.
+    Chunks(Index begin, Index end, size_t num_workers, size_t grain_size)
+      : first{ static_cast<Size>(begin) }
+      , size{ static_cast<Size>(static_cast<Size>(end) -
+                                static_cast<Size>(begin)) }
+    {
+        if (grain_size == 0) {
+            // A few chunks per worker leave enough room for stealing.
+            num_workers = std::max(num_workers, static_cast<size_t>(1));
+            grain = static_cast<Size>(size / (16 * num_workers));
+        } else if (grain_size < std::numeric_limits<Size>::max()) {
+            grain = static_cast<Size>(grain_size);
+        } else {
+            grain = size;
+        }
+        grain = std::min(std::max(grain, static_cast<Size>(1)),
+                         std::max(size, static_cast<Size>(1)));
+        count = static_cast<Size>(size / grain + (size % grain != 0));
+    }
+
+    //! enlarges chunks until there are at most `max_count` of them.
+    void limit_count(Size max_count)
+    {
+        if (count > max_count) {
+            grain = static_cast<Size>(size / max_count + 1);
+            count = static_cast<Size>(size / grain + (size % grain != 0));
+        }
+    }
+
+    //! first index of chunk `c`.
+    Index begin(Size c) const { return static_cast<Index>(first + c * grain); }
+
+    //! end of chunk `c`.
+    Index end(Size c) const
+    {
+        return static_cast<Index>(first + (c + 1 < count ? (c + 1) * grain
+                                                         : size));
+    }
+
+    Size first; //!< first index
+    Size size;  //!< number of indices
+    Size grain; //!< number of indices per chunk
+    Size count; //!< number of chunks
+};
+
+//! Learns how long a loop body takes per index, so that loops too small to
+//! pay for waking other threads run serially.
+class Cost
+{
+  public:
+    //! every thread working on a loop should get at least this much work.
+    static constexpr double min_ns_per_thread = 10000;
+
+    //! measurements shorter than this are dominated by the clock.
+    static constexpr double min_ns_sample = 1000;
+
+    //! the number of pool workers worth joining a loop over `size` indices
+    //! taking `ns_per_index` each, at most `max_workers`. 0 means the calling
+    //! thread should run the loop alone.
+    static size_t workers(double ns_per_index,
+                          std::uint64_t size,
+                          size_t max_workers)
+    {
+        const auto threads =
+          ns_per_index * static_cast<double>(size) / min_ns_per_thread;
+        if (threads < 2) {
+            return 0;
+        }
+        return static_cast<size_t>(
+          std::min(threads - 1, static_cast<double>(max_workers)));
+    }
+
+    //! moving average of the nanoseconds per index; 0 if unknown.
+    double ns_per_index() const { return ns_per_index_.load(mem::relaxed); }
+
+    //! number of indices expected to take `min_ns_sample`; 1 if unknown.
+    std::uint64_t sample_size() const
+    {
+        const auto ns = this->ns_per_index();
+        return ns == 0 ? 1
+                       : static_cast<std::uint64_t>(
+                           std::max(min_ns_sample / ns, 1.0));
+    }
+
+    //! records that the body took `ns` nanoseconds for `size` indices.
+    void record(std::chrono::nanoseconds ns, std::uint64_t size)
+    {
+        if (size == 0) {
+            return;
+        }
+        // zero means unknown, so the sample is at least a picosecond.
+        const auto sample = std::max(static_cast<double>(ns.count()) /
+                                       static_cast<double>(size),
+                                     1e-3);
+        const auto old = ns_per_index_.load(mem::relaxed);
+        ns_per_index_.store(old == 0 ? sample : old + (sample - old) / 4,
+                            mem::relaxed);
+    }
+
+  private:
+    std::atomic<double> ns_per_index_{ 0 };
+};
+
+//! runs a loop on the calling thread in blocks of doubling size from the
+//! front of `[first, last)`, until it's done or the rest is worth running in
+//! parallel. Records the cost of the body in `cost`.
+//! @param first first index of the loop; advanced past the processed blocks.
+//! @param last the loop runs in the range `[first, last)`.
+//! @param f loop body, called as `f(0, piece_begin, piece_end)`.
+//! @param cost learned cost of `f`.
+//! @param max_workers maximal number of pool workers for the rest.
+//! @param grain_size maximal number of indices per call of `f`; 0 means no
+//! limit. Blocks are timed as a whole, so the clock isn't read per call.
+//! @return the number of pool workers worth joining the rest of the loop; 0
+//! if the loop is done (or the body cancelled it).
+template<class Index, class LoopFunction>
+size_t
+run_serial_prefix(Index& first,
+                  Index last,
+                  LoopFunction& f,
+                  Cost& cost,
+                  size_t max_workers,
+                  size_t grain_size)
 {
-    auto iterators = std::make_shared<std::vector<Iterator>>();
-    iterators->reserve(static_cast<size_t>(size));
-    for (auto it = begin; it != end; ++it) {
-        iterators->push_back(it);
+    using Size = typename std::make_unsigned<Index>::type;
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::nanoseconds elapsed{ 0 };
+    std::uint64_t done = 0;
+    const auto max_piece =
+      grain_size == 0 ? std::numeric_limits<std::uint64_t>::max()
+                      : static_cast<std::uint64_t>(grain_size);
+    auto block = cost.sample_size();
+    while (first < last) {
+        const auto rest = static_cast<std::uint64_t>(
+          static_cast<Size>(static_cast<Size>(last) - static_cast<Size>(first)));
+        const auto size = std::min(block, rest);
+        for (std::uint64_t piece = 0; piece < size;) {
+            const auto n = std::min(max_piece, size - piece);
+            const auto b = static_cast<Index>(static_cast<Size>(first) +
+                                              static_cast<Size>(piece));
+            const auto e =
+              static_cast<Index>(static_cast<Size>(b) + static_cast<Size>(n));
+            if (call_body(f, 0, b, e)) {
+                return 0;
+            }
+            piece += n;
+        }
+        first = static_cast<Index>(static_cast<Size>(first) +
+                                   static_cast<Size>(size));
+        done += size;
+        block = 2 * size;
+
+        elapsed = std::chrono::steady_clock::now() - start;
+        const auto ns = static_cast<double>(elapsed.count());
+        if (ns >= Cost::min_ns_sample) {
+            const auto workers = Cost::workers(
+              ns / static_cast<double>(done), rest - size, max_workers);
+            if (workers > 0) {
+                cost.record(elapsed, done);
+                return workers;
+            }
+        }
     }
-    pool.parallel_for(0, static_cast<int>(iterators->size()), [=](int i) {
-        f(*iterators->at(static_cast<size_t>(i)));
-    });
+    cost.record(elapsed, done);
+    return 0;
 }
 
+//! Splits `size` elements into `count` contiguous blocks of (almost) equal
+//! size.
+struct Blocks
+{
+    //! first element of block `b`.
+    size_t begin(size_t b) const
+    {
+        return size / count * b + std::min(b, size % count);
+    }
+
+    //! end of block `b`.
+    size_t end(size_t b) const { return begin(b + 1); }
+
+    size_t size;  //!< number of elements
+    size_t count; //!< number of blocks
+};
+
+//! Splits a `Dim`-dimensional index space into tiles with edge length `tile`
+//! and orders them along a Morton (Z-order) curve. Consecutive tiles are close
+//! in space, so any contiguous range of tiles a loop worker owns or steals is
+//! a compact region. The last dimension varies fastest, as in row-major
+//! storage.
+//!
+//! Tiles are numbered by their Morton code on the smallest grid with a power
+//! of two tiles along every dimension that covers the space, so the position
+//! of a tile is decoded from its number on the fly. Dimensions with fewer
+//! tiles run out of code bits first; the remaining high bits belong to the
+//! others. Numbers outside the space are skipped; there are fewer than
+//! `2^Dim - 1` of them per tile in the space.
+template<size_t Dim>
+struct Tiles
+{
+    static_assert(Dim >= 2 && Dim <= 4, "only 2 to 4 dimensions supported");
+
+    Tiles(const std::array<size_t, Dim>& extents, size_t tile)
+      : extents{ extents }
+      , tile{ std::max(tile, static_cast<size_t>(1)) }
+      , counts()
+      , masks()
+      , total{ 1 }
+    {
+        std::array<size_t, Dim> bits;
+        size_t num_bits = 0;
+        for (size_t d = 0; d < Dim; ++d) {
+            counts[d] = (extents[d] + this->tile - 1) / this->tile;
+            if (counts[d] == 0) {
+                total = 0;
+            }
+            bits[d] = 0;
+            while (counts[d] > 1 && bits[d] < 64 &&
+                   (counts[d] - 1) >> bits[d] != 0) {
+                ++bits[d];
+            }
+            num_bits += bits[d];
+        }
+        if (num_bits >= std::numeric_limits<size_t>::digits) {
+            throw std::length_error("too many tiles");
+        }
+        if (total == 0) {
+            return;
+        }
+        total = static_cast<size_t>(1) << num_bits;
+
+        size_t bit = 0;
+        for (size_t level = 0; bit < num_bits; ++level) {
+            for (size_t d = Dim; d-- > 0;) {
+                if (level < bits[d]) {
+                    masks[d] |= static_cast<std::uint64_t>(1) << bit++;
+                }
+            }
+        }
+    }
+
+    //! number of tile numbers, including the ones outside the space.
+    size_t count() const { return total; }
+
+    //! decodes the position of tile `t` on the tile grid; returns `false` if
+    //! the tile lies outside the space.
+    bool locate(size_t t, std::array<size_t, Dim>& pos) const
+    {
+        for (size_t d = 0; d < Dim; ++d) {
+            pos[d] = compact(t, masks[d]);
+            if (pos[d] >= counts[d]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //! first index of the tile at `pos` along dimension `d`.
+    size_t begin(const std::array<size_t, Dim>& pos, size_t d) const
+    {
+        return pos[d] * tile;
+    }
+
+    //! end of the tile at `pos` along dimension `d`.
+    size_t end(const std::array<size_t, Dim>& pos, size_t d) const
+    {
+        return std::min(begin(pos, d) + tile, extents[d]);
+    }
+
+    //! gathers the bits of `code` selected by `mask` into the low bits.
+    static size_t compact(std::uint64_t code, std::uint64_t mask)
+    {
+        size_t x = 0;
+        for (size_t b = 0; mask != 0; mask &= mask - 1, ++b) {
+            x |= static_cast<size_t>((code & mask & (~mask + 1)) != 0) << b;
+        }
+        return x;
+    }
+
+    std::array<size_t, Dim> extents;       //!< size of each dimension
+    size_t tile;                           //!< edge length of tiles
+    std::array<size_t, Dim> counts;        //!< number of tiles per dimension
+    std::array<std::uint64_t, Dim> masks;  //!< code bits of each dimension
+    size_t total;                          //!< number of tile numbers
+};
+
 //! Worker state.
+//! @tparam T unsigned integer type counting chunks of the loop range.
+template<typename T>
 struct State
 {
-    int pos; //!< position in the loop range
-    int end; //!< end of range assigned to worker
+    T pos; //!< position in the loop range
+    T end; //!< end of range assigned to worker
 };
 
+//! checks whether worker states with 64-bit positions are lock free, i.e.,
+//! whether the platform supports 16-byte compare-and-swap without linking
+//! against libatomic.
+inline bool
+wide_state_is_lock_free()
+{
+#if QUICKPOOL_HAS_WIDE_CAS
+    static const bool lock_free =
+      std::atomic<State<std::uint64_t>>{}.is_lock_free();
+    return lock_free;
+#else
+    return false;
+#endif
+}
+
+template<typename T>
+struct Workers;
+
 //! Worker class for parallel loops.
 //!
 //! When a worker completes its own range, it steals half of the remaining range
@@ -352,48 +799,65 @@ struct State
 //! double-width compare-and-swap, which is lock-free on most modern processor
 //! architectures.
 //!
-//! @tparam type of function processing the loop (required to account for
-//! type-erasure).
-template<typename Function>
+//! Workers operate on chunks (see `Chunks`) and claim one chunk per
+//! compare-and-swap.
+//!
+//! @tparam T unsigned integer type counting chunks; `std::uint32_t` packs a
+//! state into 8 bytes, `std::uint64_t` requires 16-byte compare-and-swap.
+template<typename T>
 struct Worker
 {
-    Worker() {}
-    Worker(int begin, int end, Function fun)
-      : state{ State{ begin, end } }
-      , f{ fun }
+    //! teams up to this size look at all workers to find a victim.
+    static constexpr size_t max_scanned_team = 16;
+
+    Worker(T begin, T end)
+      : state{ State<T>{ begin, end } }
     {}
 
     Worker(Worker&& other)
       : state{ other.state.load() }
-      , f{ std::forward<Function>(other.f) }
+      , seed{ other.seed }
     {}
 
-    size_t tasks_left() const
+    T tasks_left() const
     {
-        State s = state.load();
-        return (s.end > s.pos) ? static_cast<size_t>(s.end - s.pos)
-                               : static_cast<size_t>(0);
+        State<T> s = state.load();
+        return (s.end > s.pos) ? static_cast<T>(s.end - s.pos)
+                               : static_cast<T>(0);
     }
 
     bool done() const { return (tasks_left() == 0); }
 
-    //! @param others pointer to the vector of all workers.
-    void run(std::shared_ptr<mem::aligned::vector<Worker>> others)
+    //! @param others all workers of the loop.
+    //! @param f function processing a chunk; called as `f(chunk)`.
+    //! @return the number of chunks skipped because they were cancelled
+    //! (see `Workers::cancel_from()`).
+    template<typename ChunkFunction>
+    T run(Workers<T>& others, ChunkFunction&& f)
     {
-        State s, s_old; // temporary state variables
+        T skipped = 0;
+        State<T> s, s_old; // temporary state variables
         do {
             s = state.load();
             if (s.pos < s.end) {
-                // Protect slot by trying to advance position before doing
-                // work.
+                // Protect chunk by trying to advance position before doing
+                // work. Cancelled chunks are claimed all at once.
                 s_old = s;
-                s.pos++;
+                const bool cancelled = others.cancelled(s.pos);
+                s.pos = cancelled ? s.end : static_cast<T>(s.pos + 1);
 
                 // Another worker might have changed the end of the range in
                 // the meanwhile. Check atomically if the state is unaltered
                 // and, if so, replace by advanced state.
                 if (state.compare_exchange_weak(s_old, s)) {
-                    f(s_old.pos); // succeeded, do work
+                    if (s.pos == s.end) {
+                        others.busy.fetch_sub(1); // claimed the last chunk
+                    }
+                    if (cancelled) {
+                        skipped += s.end - s_old.pos;
+                    } else {
+                        f(s_old.pos); // succeeded, do work
+                    }
                 } else {
                     continue; // failed, try again
                 }
@@ -402,84 +866,146 @@ struct Worker
                 // Reached end of own range, steal range from others. Range
                 // remains empty if all work is done, so we can leave the
                 // loop.
-                this->steal_range(*others);
+                this->steal_range(others);
             }
         } while (!this->done());
+        return skipped;
     }
 
-    //! @param workers vector of all workers.
-    void steal_range(mem::aligned::vector<Worker>& workers)
+    //! @param workers all workers of the loop.
+    void steal_range(Workers<T>& workers)
     {
         do {
             Worker& other = find_victim(workers);
-            State s = other.state.load();
+            State<T> s = other.state.load();
             if (s.pos >= s.end) {
                 continue; // other range is empty by now
             }
 
-            // Remove second half of the range. Check atomically if the
-            // state is unaltered and, if so, replace with reduced range.
+            // Remove second half of the range, or all of it if it's
+            // cancelled. Check atomically if the state is unaltered and, if
+            // so, replace with reduced range. Count our range as busy before
+            // it exists, so that the loop never looks finished in between.
             auto s_old = s;
-            s.end -= (s.end - s.pos + 1) / 2;
+            const T n = s.end - s.pos;
+            s.end -= workers.cancelled(s.pos) ? n : n / 2 + n % 2;
+            workers.busy.fetch_add(1);
             if (other.state.compare_exchange_weak(s_old, s)) {
                 // succeeded, update own range
-                state = State{ s.end, s_old.end };
+                state = State<T>{ s.end, s_old.end };
+                if (s.pos == s.end) {
+                    workers.busy.fetch_sub(1); // took the whole range
+                }
                 break;
             }
-        } while (!all_done(workers)); // failed steal, try again
+            workers.busy.fetch_sub(1);
+        } while (!workers.all_done()); // failed steal, try again
     }
 
-    //! @param workers vector of all workers.
-    bool all_done(const mem::aligned::vector<Worker>& workers)
+    //! targets the worker with the largest remaining range to minimize the
+    //! number of steal events. Small teams scan all workers; larger teams
+    //! pick the larger of two random workers' ranges, so a thief reads two
+    //! states instead of one per worker.
+    //! @param workers all workers of the loop.
+    Worker& find_victim(Workers<T>& workers)
     {
-        for (const auto& worker : workers) {
-            if (!worker.done())
-                return false;
+        const auto n = workers.size();
+        if (n <= max_scanned_team) {
+            size_t best = 0;
+            T most_tasks_left = 0;
+            for (size_t i = 0; i < n; ++i) {
+                const auto tasks_left = workers[i].tasks_left();
+                if (tasks_left > most_tasks_left) {
+                    best = i;
+                    most_tasks_left = tasks_left;
+                }
+            }
+            return workers[best];
         }
-        return true;
+
+        if (seed == 0) {
+            seed = static_cast<std::uint32_t>(this - workers.data()) + 1;
+        }
+        Worker& a = workers[this->random_index(n)];
+        Worker& b = workers[this->random_index(n)];
+        return (a.tasks_left() >= b.tasks_left()) ? a : b;
     }
 
-    //! targets the worker with the largest remaining range to minimize
-    //! number of steal events.
-    //! @param others vector of all workers.
-    Worker& find_victim(mem::aligned::vector<Worker>& workers)
+    //! draws an index in `[0, n)` from a xorshift generator.
+    size_t random_index(size_t n)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return static_cast<size_t>(seed) % n;
+    }
+
+    mem::aligned::relaxed_atomic<State<T>> state; //!< worker state `{pos, end}`
+    std::uint32_t seed{ 0 }; //!< victim selection, used by the owner only
+};
+
+//! All workers of a parallel loop.
+//!
+//! Besides the workers, tracks how many of them have a non-empty range. A
+//! range is counted before it's created and uncounted after it's emptied, so
+//! checking whether all work has been claimed takes a single load.
+template<typename T>
+struct Workers : public mem::aligned::vector<Worker<T>>
+{
+    //! replaces all workers by `num_workers` workers splitting the range
+    //! `[begin, end)`. Keeps the capacity of the vector.
+    void reset(T begin, T end, size_t num_workers)
     {
-        size_t best = 0;
-        size_t most_tasks_left = 0;
-        for (size_t i = 0; i < workers.size(); ++i) {
-            const auto tasks_left = workers[i].tasks_left();
-            if (tasks_left > most_tasks_left) {
-                best = i;
-                most_tasks_left = tasks_left;
+        const T num_tasks = (end > begin) ? static_cast<T>(end - begin) : 0;
+        num_workers = std::max(num_workers, static_cast<size_t>(1));
+        const auto n = static_cast<T>(num_workers);
+        this->clear();
+        this->reserve(num_workers);
+        busy = 0;
+        limit = std::numeric_limits<T>::max();
+        auto first = begin;
+        for (T i = 0; i < n; i++) {
+            // first (num_tasks % n) workers get one extra task
+            const auto last = static_cast<T>(first + num_tasks / n +
+                                             (i < num_tasks % n ? 1 : 0));
+            this->emplace_back(first, last);
+            if (last > first) {
+                busy++;
             }
+            first = last;
+        }
+    }
+
+    //! checks whether all chunks have been claimed.
+    bool all_done() const { return busy.load() == 0; }
+
+    //! cancels all chunks from `chunk` on; workers skip them instead of
+    //! calling the loop body.
+    void cancel_from(T chunk)
+    {
+        auto current = limit.load(mem::relaxed);
+        while (chunk < current &&
+               !limit.compare_exchange_weak(current, chunk, mem::relaxed)) {
         }
-        return workers[best];
     }
 
-    mem::aligned::relaxed_atomic<State> state; //!< worker state `{pos, end}`
-    Function f; //< function applied to the loop index
+    //! checks whether a chunk is cancelled.
+    bool cancelled(T chunk) const { return chunk >= limit.load(mem::relaxed); }
+
+    mem::aligned::atomic<size_t> busy{ 0 }; //!< workers with non-empty range
+    mem::aligned::atomic<T> limit{ std::numeric_limits<T>::max() };
 };
 
 //! creates loop workers. They must be passed to each worker using a shared
-//! pointer, so that they persist if an inner `parallel_for()` in a nested
-//! loop exits.
-template<typename Function>
-std::shared_ptr<mem::aligned::vector<Worker<Function>>>
-create_workers(const Function& f, int begin, int end, size_t num_workers)
-{
-    auto num_tasks = std::max(end - begin, static_cast<int>(0));
-    num_workers = std::max(num_workers, static_cast<size_t>(1));
-    auto workers = std::make_shared<mem::aligned::vector<Worker<Function>>>();
-    workers->reserve(num_workers);
-    for (size_t i = 0; i < num_workers; i++) {
-        const auto first =
-          begin + static_cast<int>(static_cast<size_t>(num_tasks) * i /
-                                   num_workers);
-        const auto last =
-          begin + static_cast<int>(static_cast<size_t>(num_tasks) * (i + 1) /
-                                   num_workers);
-        workers->emplace_back(first, last, f);
-    }
+//! pointer, so that they persist for tasks that start after the loop has
+//! finished.
+template<typename T>
+std::shared_ptr<Workers<T>>
+create_workers(T begin, T end, size_t num_workers)
+{
+    auto workers = std::allocate_shared<Workers<T>>(
+      mem::aligned::allocator<Workers<T>>());
+    workers->reset(begin, end, num_workers);
     return workers;
 }
 
@@ -487,9 +1013,59 @@ create_workers(const Function& f, int begin, int end, size_t num_workers)
 
 // 3. -------------------------------------------------------------------------
 
+//! How workers wait for new tasks once they run out of work.
+enum class IdlePolicy
+{
+    block, //!< park in the kernel right away
+    spin,  //!< spin with exponential backoff for a while, then park
+    poll   //!< spin until new work arrives, for dedicated cores
+};
+
 //! Task management utilities.
 namespace sched {
 
+//! index of the pool worker running on the current thread; the maximal
+//! `size_t` if the current thread isn't a pool worker.
+inline size_t&
+this_worker_id()
+{
+    static thread_local size_t id = std::numeric_limits<size_t>::max();
+    return id;
+}
+
+//! lane for the next task the current thread pushes from outside a pool.
+//! Threads start at different lanes and then go round robin, so they don't
+//! share a counter.
+inline size_t
+next_lane()
+{
+    static std::atomic<size_t> threads{ 0 };
+    static thread_local size_t lane = threads.fetch_add(1, mem::relaxed);
+    return lane++;
+}
+
+//! task manager of the pool the current thread works for; `nullptr` if the
+//! current thread isn't a pool worker.
+inline const void*&
+this_worker_owner()
+{
+    static thread_local const void* owner = nullptr;
+    return owner;
+}
+
+//! tells the processor that the calling thread spins.
+inline void
+cpu_relax()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
 //! A simple ring buffer class.
 template<typename T>
 class RingBuffer
@@ -505,14 +1081,14 @@ class RingBuffer
 
     size_t capacity() const { return capacity_; }
 
-    void set_entry(size_t i, T val)
+    void set_entry(size_t i, T val, std::memory_order order = mem::relaxed)
     {
-        buffer_[i & mask_].store(val, mem::relaxed);
+        buffer_[i & mask_].store(val, order);
     }
 
-    T get_entry(size_t i) const
+    T get_entry(size_t i, std::memory_order order = mem::relaxed) const
     {
-        return buffer_[i & mask_].load(mem::relaxed);
+        return buffer_[i & mask_].load(order);
     }
 
     RingBuffer<T>* enlarged_copy(size_t bottom, size_t top) const
@@ -529,17 +1105,58 @@ class RingBuffer
     size_t mask_;
 };
 
+//! A task stored in a queue.
+struct TaskNode
+{
+    std::function<void()> task;
+    bool tracked{ false }; //!< see `TaskManager::push_tracked()`
+    TaskNode* next{ nullptr };
+};
+
+//! Owns task nodes and keeps those available for reuse in a free list. Only
+//! one thread at a time may acquire nodes, while any thread may recycle them.
+class TaskNodePool
+{
+  public:
+    TaskNode* acquire()
+    {
+        auto node = free_nodes_.load(mem::acquire);
+        while (node != nullptr) {
+            auto next = node->next;
+            if (free_nodes_.compare_exchange_weak(
+                  node, next, mem::acquire, mem::acquire)) {
+                node->next = nullptr;
+                return node;
+            }
+        }
+
+        allocated_nodes_.emplace_back(new TaskNode);
+        return allocated_nodes_.back().get();
+    }
+
+    void recycle(TaskNode* node) noexcept
+    {
+        node->task = nullptr;
+        auto head = free_nodes_.load(mem::relaxed);
+        do {
+            node->next = head;
+        } while (!free_nodes_.compare_exchange_weak(
+          head, node, mem::release, mem::relaxed));
+    }
+
+  private:
+    //! owning storage for all allocated task nodes
+    std::vector<std::unique_ptr<TaskNode>> allocated_nodes_;
+
+    //! nodes available for reuse
+    std::atomic<TaskNode*> free_nodes_{ nullptr };
+};
+
 //! A multi-producer, multi-consumer queue; pops are lock free.
 class TaskQueue
 {
     using Task = std::function<void()>;
 
-    struct TaskNode
-    {
-        Task task;
-        TaskNode* next{ nullptr };
-    };
-
   public:
     //! @param capacity must be a power of two.
     TaskQueue(size_t capacity = 256)
@@ -560,9 +1177,25 @@ class TaskQueue
         return (bottom_.load(mem::relaxed) <= top_.load(mem::relaxed));
     }
 
-    //! pushes a task to the bottom of the queue; returns false if queue is
-    //! currently locked; enlarges the queue if full.
-    void push(Task&& task)
+    //! pushes a task to the bottom of the queue; enlarges the queue if full.
+    //! @param tracked see `TaskManager::push_tracked()`.
+    void push(Task&& task, bool tracked = false)
+    {
+        size_t pushed = 0;
+        this->push_n(
+          1,
+          [&task](size_t) -> Task&& { return std::move(task); },
+          pushed,
+          tracked);
+    }
+
+    //! pushes the tasks `make(0), ..., make(n - 1)` to the bottom of the
+    //! queue with a single lock and wake up; enlarges the queue if needed.
+    //! If `make` throws, the tasks made before are pushed.
+    //! @param pushed incremented by the number of pushed tasks.
+    //! @param tracked see `TaskManager::push_tracked()`.
+    template<class Make>
+    void push_n(size_t n, Make&& make, size_t& pushed, bool tracked = false)
     {
         // Must hold lock in case of multiple producers.
         std::unique_lock<std::mutex> lk(mutex_);
@@ -571,7 +1204,7 @@ class TaskQueue
         RingBuffer<TaskNode*>* buf_ptr = buffer_.load(mem::relaxed);
 
         const auto size = b - t;
-        if (buf_ptr->capacity() < size + 1) {
+        while (buf_ptr->capacity() < size + n) {
             // Buffer is full, create enlarged copy before continuing.
             auto old_buf = buf_ptr;
             buf_ptr = std::move(buf_ptr->enlarged_copy(b, t));
@@ -579,67 +1212,61 @@ class TaskQueue
             buffer_.store(buf_ptr, mem::release);
         }
 
-        auto node = acquire_node();
+        // Store pointers to task nodes in the ring buffer, then publish all
+        // of them at once.
+        size_t i = 0;
+        std::exception_ptr error{ nullptr };
         try {
-            node->task = std::forward<Task>(task);
+            for (; i < n; ++i) {
+                auto node = nodes_.acquire();
+                try {
+                    node->task = make(i);
+                } catch (...) {
+                    nodes_.recycle(node);
+                    throw;
+                }
+                node->tracked = tracked;
+                buf_ptr->set_entry(b + i, node);
+            }
         } catch (...) {
-            recycle_node(node);
-            throw;
+            error = std::current_exception();
         }
-        //! Store pointer to task node in ring buffer.
-        buf_ptr->set_entry(b, node);
-        bottom_.store(b + 1, mem::release);
+        bottom_.store(b + i, mem::release);
+        pushed += i;
 
-        lk.unlock(); // can release before signal
-        cv_.notify_one();
+        lk.unlock();
+        if (error) {
+            std::rethrow_exception(error);
+        }
     }
 
-    //! pops a task from the top of the queue; returns false if lost race.
-    bool try_pop(Task& task)
+    //! pops a task from the top of the queue; returns false if it is empty.
+    //! @param tracked set to whether the task was pushed as tracked.
+    bool try_pop(Task& task, bool& tracked)
     {
         auto t = top_.load(mem::acquire);
-        std::atomic_thread_fence(mem::seq_cst);
-        auto b = bottom_.load(mem::acquire);
+        while (true) {
+            std::atomic_thread_fence(mem::seq_cst);
+            auto b = bottom_.load(mem::acquire);
+            if (t >= b) {
+                return false; // queue is empty
+            }
 
-        if (t < b) {
             // Must load task pointer before acquiring the slot, because it
             // could be overwritten immediately after.
             auto node = buffer_.load(mem::acquire)->get_entry(t);
 
-            // Atomically try to advance top.
+            // Atomically try to advance top. After losing a race, try again:
+            // threads waiting for a latch only block once all queues are
+            // empty, so tasks must not be missed.
             if (top_.compare_exchange_strong(
                   t, t + 1, mem::seq_cst, mem::relaxed)) {
                 task = std::move(node->task); // won race, get task
-                recycle_node(node);
+                tracked = node->tracked;
+                nodes_.recycle(node);
                 return true;
             }
         }
-        return false; // queue is empty or lost race
-    }
-
-    //! waits for tasks or stop signal.
-    void wait()
-    {
-        std::unique_lock<std::mutex> lk(mutex_);
-        cv_.wait(lk, [this] { return !this->empty() || stopped_; });
-    }
-
-    //! stops the queue and wakes up all workers waiting for jobs.
-    void stop()
-    {
-        {
-            std::lock_guard<std::mutex> lk(mutex_);
-            stopped_ = true;
-        }
-        cv_.notify_one();
-    }
-
-    void wake_up()
-    {
-        {
-            std::lock_guard<std::mutex> lk(mutex_);
-        }
-        cv_.notify_one();
     }
 
   private:
@@ -653,550 +1280,3932 @@ class TaskQueue
     //! pointers to buffers that were replaced by enlarged buffer
     std::vector<std::unique_ptr<RingBuffer<TaskNode*>>> old_buffers_;
 
-    //! owning storage for all allocated task nodes
-    std::vector<std::unique_ptr<TaskNode>> allocated_nodes_;
+    //! task nodes; only push_n() acquires nodes, and it holds mutex_, while
+    //! many worker threads may recycle nodes concurrently.
+    TaskNodePool nodes_;
 
-    //! nodes available for reuse
-    std::atomic<TaskNode*> free_nodes_{ nullptr };
+    //! serializes producers
+    std::mutex mutex_;
+};
+
+//! A work-stealing deque (Chase-Lev). Only the owning worker pushes and pops
+//! at the bottom, without any locks; it runs its most recent tasks first,
+//! while their data is still in cache. Other workers steal the oldest tasks
+//! from the top.
+class WorkerDeque
+{
+    using Task = std::function<void()>;
+
+  public:
+    //! @param capacity must be a power of two.
+    WorkerDeque(size_t capacity = 256)
+      : buffer_{ new RingBuffer<TaskNode*>(capacity) }
+    {}
 
-    // Only push() calls acquire_node(), and push() holds mutex_, while many
-    // worker threads may recycle nodes concurrently.
-    TaskNode* acquire_node()
+    ~WorkerDeque() noexcept
     {
-        auto node = free_nodes_.load(mem::acquire);
-        while (node != nullptr) {
-            auto next = node->next;
-            if (free_nodes_.compare_exchange_weak(
-                  node, next, mem::acquire, mem::acquire)) {
-                node->next = nullptr;
-                return node;
-            }
+        delete buffer_.load();
+    }
+
+    WorkerDeque(WorkerDeque const& other) = delete;
+    WorkerDeque& operator=(WorkerDeque const& other) = delete;
+
+    //! pushes a task to the bottom of the deque; enlarges the deque if full.
+    //! Must only be called by the owner.
+    //! @param tracked see `TaskManager::push_tracked()`.
+    void push(Task&& task, bool tracked = false)
+    {
+        auto b = bottom_.load(mem::relaxed);
+        auto t = top_.load(mem::acquire);
+        RingBuffer<TaskNode*>* buf_ptr = buffer_.load(mem::relaxed);
+
+        if (buf_ptr->capacity() < static_cast<size_t>(b - t) + 1) {
+            // Buffer is full, create enlarged copy before continuing.
+            auto old_buf = buf_ptr;
+            buf_ptr = std::move(buf_ptr->enlarged_copy(b, t));
+            old_buffers_.emplace_back(old_buf);
+            buffer_.store(buf_ptr, mem::release);
         }
 
-        allocated_nodes_.emplace_back(new TaskNode);
-        return allocated_nodes_.back().get();
+        auto node = nodes_.acquire();
+        try {
+            node->task = std::move(task);
+        } catch (...) {
+            nodes_.recycle(node);
+            throw;
+        }
+        node->tracked = tracked;
+
+        // Thieves synchronize with the entry, so they see the task even if
+        // the owner moved the bottom since.
+        buf_ptr->set_entry(b, node, mem::release);
+        bottom_.store(b + 1, mem::release);
     }
 
-    void recycle_node(TaskNode* node) noexcept
+    //! pops the most recent task from the bottom of the deque; returns false
+    //! if it is empty. Must only be called by the owner.
+    //! @param tracked set to whether the task was pushed as tracked.
+    bool pop(Task& task, bool& tracked)
     {
-        node->task = nullptr;
-        auto head = free_nodes_.load(mem::relaxed);
-        do {
-            node->next = head;
-        } while (!free_nodes_.compare_exchange_weak(
-          head, node, mem::release, mem::relaxed));
+        auto b = bottom_.load(mem::relaxed) - 1;
+        auto buf_ptr = buffer_.load(mem::relaxed);
+        bottom_.store(b, mem::relaxed);
+        std::atomic_thread_fence(mem::seq_cst);
+        auto t = top_.load(mem::relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, mem::relaxed);
+            return false; // deque is empty
+        }
+
+        auto node = buf_ptr->get_entry(b);
+        if (t == b) {
+            // Last task, race against thieves.
+            bool won = top_.compare_exchange_strong(
+              t, t + 1, mem::seq_cst, mem::relaxed);
+            bottom_.store(b + 1, mem::relaxed);
+            if (!won) {
+                return false;
+            }
+        }
+        task = std::move(node->task);
+        tracked = node->tracked;
+        nodes_.recycle(node);
+        return true;
     }
 
-    //! synchronization variables
-    std::mutex mutex_;
-    std::condition_variable cv_;
-    bool stopped_{ false };
+    //! steals the oldest task from the top of the deque; returns false if
+    //! it is empty.
+    //! @param tracked set to whether the task was pushed as tracked.
+    bool steal(Task& task, bool& tracked)
+    {
+        auto t = top_.load(mem::acquire);
+        while (true) {
+            std::atomic_thread_fence(mem::seq_cst);
+            auto b = bottom_.load(mem::acquire);
+            if (t >= b) {
+                return false; // deque is empty
+            }
+
+            // Must load task pointer before acquiring the slot, because it
+            // could be overwritten immediately after.
+            auto node = buffer_.load(mem::acquire)->get_entry(t, mem::acquire);
+
+            // After losing a race, try again (see TaskQueue::try_pop()).
+            if (top_.compare_exchange_strong(
+                  t, t + 1, mem::seq_cst, mem::relaxed)) {
+                task = std::move(node->task); // won race, get task
+                tracked = node->tracked;
+                nodes_.recycle(node);
+                return true;
+            }
+        }
+    }
+
+  private:
+    //! deque indices; signed, since the owner's pop may move the bottom
+    //! below the top temporarily.
+    mem::aligned::atomic<std::int64_t> top_{ 0 };
+    mem::aligned::atomic<std::int64_t> bottom_{ 0 };
+
+    //! ring buffer holding task pointers
+    std::atomic<RingBuffer<TaskNode*>*> buffer_{ nullptr };
+
+    //! pointers to buffers that were replaced by enlarged buffer
+    std::vector<std::unique_ptr<RingBuffer<TaskNode*>>> old_buffers_;
+
+    //! task nodes; only the owner acquires nodes.
+    TaskNodePool nodes_;
 };
 
-//! Task manager based on work stealing.
-class TaskManager
+//! A bounded multi-producer, multi-consumer queue without locks (Vyukov).
+//! Every cell carries a sequence number telling whether it is free for the
+//! producer or filled for the consumer at a given position, so pushes and
+//! pops only contend on their own position counter.
+class InjectionQueue
 {
-  public:
-    explicit TaskManager(size_t num_queues)
-      : queues_(std::max(num_queues, static_cast<size_t>(1)))
-      , num_queues_(std::max(num_queues, static_cast<size_t>(1)))
-      , owner_id_(std::this_thread::get_id())
-    {}
+    using Task = std::function<void()>;
 
-    TaskManager& operator=(TaskManager&& other)
+    struct Cell
     {
-        std::swap(queues_, other.queues_);
-        num_queues_ = other.num_queues_;
-        status_ = other.status_.load();
-        num_waiting_ = other.num_waiting_.load();
-        push_idx_ = other.push_idx_.load();
-        todo_ = other.todo_.load();
-        return *this;
-    }
+        std::atomic<size_t> seq;
+        Task task;
+        bool tracked{ false };
+    };
 
-    void resize(size_t num_queues)
+  public:
+    //! @param capacity must be a power of two.
+    InjectionQueue(size_t capacity = 256)
+      : cells_{ new Cell[capacity] }
+      , mask_{ capacity - 1 }
     {
-        if (!done()) {
-            throw std::logic_error("cannot resize with pending tasks");
-        }
-        num_queues_ = std::max(num_queues, static_cast<size_t>(1));
-        if (num_queues_ > queues_.size()) {
-            queues_ = mem::aligned::vector<TaskQueue>(num_queues_);
-            // thread pool must have stopped the manager, reset
-            num_waiting_ = 0;
-            todo_ = 0;
-            status_ = Status::running;
+        for (size_t i = 0; i < capacity; ++i) {
+            cells_[i].seq.store(i, mem::relaxed);
         }
     }
 
-    template<typename Task>
-    void push(Task&& task)
+    InjectionQueue(InjectionQueue const& other) = delete;
+    InjectionQueue& operator=(InjectionQueue const& other) = delete;
+
+    //! moves a task into the queue; returns false if the queue is full.
+    //! @param tracked see `TaskManager::push_tracked()`.
+    bool push(Task& task, bool tracked = false) noexcept
     {
-        rethrow_exception(); // push() throws if a task has errored.
-        if (is_running()) {
-            todo_.fetch_add(1, mem::release);
-            try {
-                queues_[push_idx_++ % num_queues_].push(task);
-            } catch (...) {
-                report_success();
-                throw;
+        auto pos = enqueue_pos_.load(mem::relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            const auto seq = cell->seq.load(mem::acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(
+                      pos, pos + 1, mem::relaxed, mem::relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // queue is full
+            } else {
+                pos = enqueue_pos_.load(mem::relaxed);
             }
         }
+        cell->task.swap(task);
+        cell->tracked = tracked;
+        cell->seq.store(pos + 1, mem::release);
+        return true;
     }
 
-    template<typename Task>
-    bool try_pop(Task& task, size_t worker_id = 0)
+    //! pops the oldest task; returns false if the queue is empty.
+    //! @param tracked set to whether the task was pushed as tracked.
+    bool pop(Task& task, bool& tracked)
     {
-        // Always start pop cycle at own queue to avoid contention.
-        for (size_t k = 0; k < num_queues_; k++) {
-            if (queues_[(worker_id + k) % num_queues_].try_pop(task)) {
-                if (is_running()) {
-                    return true;
-                } else {
-                    // Throw away task if pool has stopped or errored.
-                    return false;
+        auto pos = dequeue_pos_.load(mem::relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            const auto seq = cell->seq.load(mem::acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(
+                      pos, pos + 1, mem::relaxed, mem::relaxed)) {
+                    break;
                 }
+            } else if (diff < 0) {
+                return false; // queue is empty
+            } else {
+                pos = dequeue_pos_.load(mem::relaxed);
             }
         }
-
-        return false;
+        task = std::move(cell->task);
+        tracked = cell->tracked;
+        cell->task = nullptr;
+        cell->seq.store(pos + mask_ + 1, mem::release);
+        return true;
     }
 
-    void wake_up_all_workers()
+  private:
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+
+    //! positions of the next push and pop
+    mem::aligned::atomic<size_t> enqueue_pos_{ 0 };
+    mem::aligned::atomic<size_t> dequeue_pos_{ 0 };
+};
+
+//! An event count for parking idle workers. A waiter announces itself with
+//! prepare_wait(), re-checks its wake up condition, and only then blocks in
+//! commit_wait(). Notifiers check for announced waiters first, so they skip
+//! the kernel while nobody sleeps. Waiters block on a futex on Linux and on a
+//! condition variable elsewhere.
+class EventCount
+{
+  public:
+    EventCount() = default;
+    EventCount(EventCount const& other) = delete;
+    EventCount& operator=(EventCount const& other) = delete;
+
+    //! announces a waiter; returns the key to pass to commit_wait().
+    std::uint32_t prepare_wait()
     {
-        for (auto& q : queues_)
-            q.wake_up();
+        waiters_.fetch_add(1, mem::seq_cst);
+        // The waiter's next loads must not move before its announcement
+        // (pairs with the fence in notify()).
+        std::atomic_thread_fence(mem::seq_cst);
+        return epoch_.load(mem::acquire);
     }
 
-    void wait_for_jobs(size_t id)
+    //! withdraws the announcement of a waiter that doesn't need to block.
+    void cancel_wait() { waiters_.fetch_sub(1, mem::seq_cst); }
+
+    //! blocks until a notification after prepare_wait() returned `key`.
+    void commit_wait(std::uint32_t key)
     {
-        if (has_errored()) {
-            // Main thread may be waiting to reset the pool.
-            std::lock_guard<std::mutex> lk(mtx_);
-            if (++num_waiting_ == queues_.size())
-                cv_.notify_all();
-        } else {
-            ++num_waiting_;
+#if (defined __linux__)
+        while (epoch_.load(mem::acquire) == key) {
+            // Returns immediately if the epoch has changed already.
+            syscall(SYS_futex,
+                    reinterpret_cast<std::uint32_t*>(&epoch_),
+                    FUTEX_WAIT_PRIVATE,
+                    key,
+                    nullptr,
+                    nullptr,
+                    0);
         }
-
-        queues_[id].wait();
-        --num_waiting_;
+#else
+        std::unique_lock<std::mutex> lk(mutex_);
+        cv_.wait(lk, [&] { return epoch_.load(mem::acquire) != key; });
+#endif
+        waiters_.fetch_sub(1, mem::seq_cst);
     }
 
-    //! @param millis if > 0: stops waiting after millis ms
-    void wait_for_finish(size_t millis = 0)
+    //! wakes up `n` waiters (all of them if there are fewer); does nothing
+    //! if nobody is waiting. The wake up condition must be set before.
+    void notify(size_t n = 1)
     {
-        if (called_from_owner_thread() && is_running()) {
-            auto wake_up = [this] { return (todo_ <= 0) || !is_running(); };
-            std::unique_lock<std::mutex> lk(mtx_);
-            if (millis == 0) {
-                cv_.wait(lk, wake_up);
-            } else {
-                cv_.wait_for(lk, std::chrono::milliseconds(millis), wake_up);
+        std::atomic_thread_fence(mem::seq_cst);
+        const auto waiters = waiters_.load(mem::relaxed);
+        if (waiters == 0 || n == 0) {
+            return;
+        }
+        epoch_.fetch_add(1, mem::release);
+#if (defined __linux__)
+        const size_t max_wake = std::numeric_limits<int>::max();
+        syscall(SYS_futex,
+                reinterpret_cast<std::uint32_t*>(&epoch_),
+                FUTEX_WAKE_PRIVATE,
+                static_cast<int>(std::min(n, max_wake)),
+                nullptr,
+                nullptr,
+                0);
+#else
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+        }
+        if (n >= waiters) {
+            cv_.notify_all();
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                cv_.notify_one();
             }
         }
-        rethrow_exception();
+#endif
     }
 
-    bool called_from_owner_thread() const
+  private:
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+                  "futex word must be a plain 32-bit integer");
+
+    //! number of announced waiters
+    mem::aligned::atomic<size_t> waiters_{ 0 };
+
+    //! incremented by every notification that finds waiters
+    mem::aligned::atomic<std::uint32_t> epoch_{ 0 };
+
+#if !(defined __linux__)
+    std::mutex mutex_;
+    std::condition_variable cv_;
+#endif
+};
+
+//! Tracks the outstanding work of a parallel construct (e.g., the chunks of a
+//! parallel loop) and the first exception thrown while processing it.
+class Latch
+{
+  public:
+    explicit Latch(std::uint64_t count)
+      : count_{ count }
+    {}
+
+    Latch(const Latch&) = delete;
+    Latch& operator=(const Latch&) = delete;
+
+    //! A callback registered with `on_done()`. Waiters are owned by the
+    //! caller and linked into a list, so any number of them can wait without
+    //! allocating.
+    struct Waiter
     {
-        return (std::this_thread::get_id() == owner_id_);
+        void (*callback)(void*);
+        void* data;
+        Waiter* next;
+    };
+
+    //! re-arms the latch with `count` units of work; nobody may use the latch
+    //! concurrently.
+    void reset(std::uint64_t count)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        count_ = count;
+        err_ptr_ = nullptr;
+        errored_ = false;
+        waiters_ = nullptr;
     }
 
-    void report_success()
+    //! adds `n` units of work; only while the latch isn't done or nobody
+    //! waits for it.
+    void count_up(std::uint64_t n = 1)
     {
+        count_.fetch_add(n, std::memory_order_acq_rel);
+    }
 
-        auto n = todo_.fetch_sub(1, mem::release) - 1;
+    //! marks `n` units of work as finished.
+    void count_down(std::uint64_t n = 1)
+    {
         if (n == 0) {
-            // all jobs are done; lock before signal to prevent spurious
-            // failure
-            {
-                std::lock_guard<std::mutex> lk{ mtx_ };
+            return;
+        }
+        auto c = count_.load(mem::relaxed);
+        while (c > n) {
+            if (count_.compare_exchange_weak(
+                  c, c - n, std::memory_order_acq_rel, mem::relaxed)) {
+                return;
             }
+        }
+        // The last unit is counted down under the lock: waiters only return
+        // after locking (see `wait()`), so the latch can't be destroyed while
+        // we still notify.
+        std::unique_lock<std::mutex> lk(mtx_);
+        if (count_.fetch_sub(n, std::memory_order_acq_rel) == n) {
             cv_.notify_all();
+            auto waiter = waiters_;
+            waiters_ = nullptr;
+            lk.unlock();
+            while (waiter) {
+                // The callback may end the lifetime of the waiter.
+                auto next = waiter->next;
+                waiter->callback(waiter->data);
+                waiter = next;
+            }
         }
     }
 
-    void report_fail(std::exception_ptr err_ptr)
+    //! calls `waiter.callback(waiter.data)` once all work is finished,
+    //! instead of blocking in `wait()`; returns false without storing the
+    //! waiter if the work is finished already. `waiter` must stay alive until
+    //! it is called.
+    bool on_done(Waiter& waiter)
     {
         std::lock_guard<std::mutex> lk(mtx_);
-        if (has_errored()) // only catch first exception
-            return;
-        err_ptr_ = err_ptr;
-        status_ = Status::errored;
+        if (this->done()) {
+            return false;
+        }
+        waiter.next = waiters_;
+        waiters_ = &waiter;
+        return true;
+    }
 
-        // Some threads may change todo_ after we stop. The large
-        // negative number forces them to exit the processing loop.
-        todo_.store(std::numeric_limits<int>::min() / 2);
-        cv_.notify_all();
+    //! checks whether all work is finished.
+    bool done() const { return count_.load(mem::acquire) == 0; }
+
+    //! blocks until all work is finished. Owners must call this before
+    //! destroying or re-arming the latch, even if `done()` is already true.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        cv_.wait(lk, [this] { return this->done(); });
     }
 
-    void stop()
+    //! stores an exception; only the first one is kept.
+    void report_fail(std::exception_ptr err_ptr)
     {
-        {
-            std::lock_guard<std::mutex> lk(mtx_);
-            status_ = Status::stopped;
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (errored_.load(mem::relaxed)) {
+            return;
         }
-        // Worker threads wait on queue-specific mutex -> notify all queues.
-        for (auto& q : queues_)
-            q.stop();
+        err_ptr_ = err_ptr;
+        errored_.store(true, mem::relaxed);
     }
 
-    void rethrow_exception()
+    bool has_errored() const { return errored_.load(mem::relaxed); }
+
+    //! returns the stored exception, if any; call only once `done()`.
+    std::exception_ptr error()
     {
-        // Exceptions are only thrown from the owner thread, not in workers.
-        if (called_from_owner_thread() && has_errored()) {
-            {
-                // Wait for all threads to idle so we can clean up after
-                // them.
-                std::unique_lock<std::mutex> lk(mtx_);
-                cv_.wait(lk, [this] { return num_waiting_ == queues_.size(); });
-            }
-            // Before throwing: restore defaults for potential future use of
-            // the task manager.
-            todo_ = 0;
-            auto current_exception = err_ptr_;
-            err_ptr_ = nullptr;
-            status_ = Status::running;
-
-            std::rethrow_exception(current_exception);
-        }
+        std::lock_guard<std::mutex> lk(mtx_);
+        return err_ptr_;
     }
 
-    bool is_running() const
-    {
-        return status_.load(mem::relaxed) == Status::running;
-    }
+  private:
+    std::atomic<std::uint64_t> count_;
+    std::atomic_bool errored_{ false };
+    std::exception_ptr err_ptr_{ nullptr };
+    Waiter* waiters_{ nullptr }; //!< see `on_done()`
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
 
-    bool has_errored() const
-    {
-        return status_.load(mem::relaxed) == Status::errored;
-    }
+//! A job run by several workers at once. Instead of pushing one task per
+//! worker, the job is published once with a number of tickets; each worker
+//! looking for work claims one ticket and runs the job with it.
+struct Broadcast
+{
+    using Run = void (*)(Broadcast& job, size_t ticket);
 
-    bool stopped() const
+    //! claims one of the remaining tickets, which are handed out from
+    //! `tickets - 1` down to 0; returns false if there are none left.
+    bool claim(size_t& ticket)
     {
-        return status_.load(mem::relaxed) == Status::stopped;
+        auto t = tickets.load(mem::acquire);
+        do {
+            if (t == 0) {
+                return false;
+            }
+        } while (!tickets.compare_exchange_weak(
+          t, t - 1, std::memory_order_acq_rel));
+        ticket = t - 1;
+        return true;
     }
 
-    bool done() const { return (todo_.load(mem::relaxed) <= 0); }
+    //! withdraws all unclaimed tickets; returns how many there were.
+    size_t close() { return tickets.exchange(0, std::memory_order_acq_rel); }
 
-  private:
-    //! worker queues
-    mem::aligned::vector<TaskQueue> queues_;
-    size_t num_queues_;
+    std::atomic<size_t> tickets{ 0 };
+    Run run{ nullptr };
+};
 
-    //! task management
-    mem::aligned::relaxed_atomic<size_t> num_waiting_{ 0 };
-    mem::aligned::relaxed_atomic<size_t> push_idx_{ 0 };
-    mem::aligned::atomic<int> todo_{ 0 };
+template<typename T>
+class LoopFrames;
 
-    //! synchronization variables
-    const std::thread::id owner_id_;
-    enum class Status
+//! State of a running parallel loop: its workers, a latch counting the
+//! unprocessed chunks, and the loop body.
+//!
+//! The body is only referenced; it lives on the stack of the thread that
+//! started the loop. That's safe, because a job calls the body only for a
+//! chunk it claimed, and all chunks are processed before the loop returns.
+//! Jobs starting later only find empty ranges, but still need the workers,
+//! so a frame is recycled when the last job has released it.
+template<typename T>
+struct LoopFrame : public Broadcast
+{
+    using Call = void (*)(LoopFrame& frame, size_t k, T chunk);
+
+    LoopFrame() { this->run = &LoopFrame::run_ticket; }
+
+    //! runs the loop worker with index `ticket` for a broadcast job.
+    static void run_ticket(Broadcast& job, size_t ticket)
     {
-        running,
-        errored,
-        stopped
-    };
-    mem::aligned::atomic<Status> status_{ Status::running };
-    std::mutex mtx_;
-    std::condition_variable cv_;
-    std::exception_ptr err_ptr_{ nullptr };
-};
+        auto& frame = static_cast<LoopFrame&>(job);
+        frame.run_worker(ticket);
+        frame.release();
+    }
 
-// find out which cores are allowed for use by pthread
-inline std::vector<size_t>
-get_avail_cores()
-{
-    auto ncores = std::thread::hardware_concurrency();
-    std::vector<size_t> avail_cores;
-    avail_cores.reserve(ncores);
-#if (defined __linux__)
-    cpu_set_t cpuset;
-    int rc = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
-    if (rc != 0) {
-        throw std::runtime_error("Error calling pthread_getaffinity_np");
+    //! runs loop worker `k` until all chunks of the loop are claimed. Once
+    //! the loop body has thrown, remaining chunks are cancelled.
+    void run_worker(size_t k)
+    {
+        std::uint64_t processed = 0;
+        const auto skipped = workers[k].run(workers, [&](T c) {
+            ++processed;
+            if (latch.has_errored()) {
+                return;
+            }
+            try {
+                call(*this, k, c);
+            } catch (...) {
+                latch.report_fail(std::current_exception());
+                workers.cancel_from(0);
+            }
+        });
+        latch.count_down(processed + skipped);
     }
-    for (size_t id = 0; id < ncores; id++) {
-        if (CPU_ISSET(id, &cpuset)) {
-            avail_cores.push_back(id);
+
+    //! gives up one reference; the last one returns the frame to its pool.
+    void release()
+    {
+        if (users.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            owner->recycle(this);
         }
     }
-#endif
-    return avail_cores;
-}
 
-inline size_t
-num_cores_avail()
-{
-#if (defined __linux__)
-    return get_avail_cores().size();
-#endif
-    return std::thread::hardware_concurrency();
-}
+    static void* operator new(size_t count)
+    {
+        auto p = mem::aligned::alloc(alignof(LoopFrame), count);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
 
-} // end namespace sched
+    static void operator delete(void* ptr) { mem::aligned::free(ptr); }
 
-// 4. ------------------------------------------------------------------------
+    loop::Workers<T> workers;
+    Latch latch{ 0 };
+    void* body{ nullptr }; //!< loop body on the caller's stack
+    Call call{ nullptr };  //!< calls the body for a chunk
+    std::atomic<size_t> users{ 0 };
+    LoopFrames<T>* owner{ nullptr };
+};
 
-//! A work stealing thread pool.
-class ThreadPool
+//! Recycles loop frames. Once as many frames exist as loops run
+//! concurrently, and their worker vectors are large enough, starting a loop
+//! doesn't allocate.
+template<typename T>
+class LoopFrames
 {
   public:
-    //! @brief constructs a thread pool.
-    //! @param threads number of worker threads to create; defaults to
-    //! number of available (virtual) hardware cores.
-    explicit ThreadPool(size_t threads = sched::num_cores_avail())
-      : task_manager_{ threads }
+    //! hands out a frame with `users` references.
+    LoopFrame<T>* acquire(size_t users)
     {
-        set_active_threads(threads);
+        LoopFrame<T>* frame = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (free_.empty()) {
+                free_.reserve(frames_.size() + 1);
+                std::unique_ptr<LoopFrame<T>> fresh{ new LoopFrame<T> };
+                fresh->owner = this;
+                frames_.push_back(std::move(fresh));
+                frame = frames_.back().get();
+            } else {
+                frame = free_.back();
+                free_.pop_back();
+            }
+        }
+        frame->users = users;
+        return frame;
     }
 
-    ~ThreadPool()
+    //! returns a frame nobody uses anymore.
+    void recycle(LoopFrame<T>* frame)
     {
-        task_manager_.stop();
-        join_threads();
+        std::lock_guard<std::mutex> lk(mtx_);
+        free_.push_back(frame); // never allocates, see acquire()
     }
 
-    ThreadPool(ThreadPool&&) = delete;
-    ThreadPool(const ThreadPool&) = delete;
-    ThreadPool& operator=(const ThreadPool&) = delete;
-    ThreadPool& operator=(ThreadPool&& other) = delete;
+  private:
+    std::mutex mtx_;
+    std::vector<std::unique_ptr<LoopFrame<T>>> frames_;
+    std::vector<LoopFrame<T>*> free_;
+};
 
-    //! @brief returns a reference to the global thread pool instance.
-    static ThreadPool& global_instance()
+//! Task manager based on work stealing.
+class TaskManager
+{
+  public:
+    explicit TaskManager(size_t num_queues,
+                         IdlePolicy idle_policy = IdlePolicy::block)
+      : queues_(std::max(num_queues, static_cast<size_t>(1)))
+      , deques_(std::max(num_queues, static_cast<size_t>(1)))
+      , lanes_(std::max(num_queues, static_cast<size_t>(1)))
+      , num_queues_(std::max(num_queues, static_cast<size_t>(1)))
+      , idle_policy_(idle_policy)
+      , owner_id_(std::this_thread::get_id())
+    {}
+
+    TaskManager& operator=(TaskManager&& other)
     {
-#ifdef _WIN32
-        // Must leak resource, because windows + R deadlock otherwise.
-        // Memory is released on shutdown.
-        static auto ptr = new ThreadPool;
-        return *ptr;
-#else
-        static ThreadPool instance_;
-        return instance_;
-#endif
+        std::swap(queues_, other.queues_);
+        std::swap(deques_, other.deques_);
+        std::swap(lanes_, other.lanes_);
+        num_queues_ = other.num_queues_;
+        status_ = other.status_.load();
+        num_waiting_ = other.num_waiting_.load();
+        push_idx_ = other.push_idx_.load();
+        todo_ = other.todo_.load();
+        board_ = other.board_.load();
+        idle_policy_ = other.idle_policy_.load();
+        return *this;
     }
 
-    //! @brief sets the number of active worker threads in the thread pool.
-    //! @param threads the number of worker threads.
-    //! Has no effect when not called from owner thread.
-    void set_active_threads(size_t threads)
+    void resize(size_t num_queues)
     {
-        if (!task_manager_.called_from_owner_thread())
-            return;
-
-        if (threads == active_threads_.load(mem::relaxed)) {
-            return;
+        if (!done()) {
+            throw std::logic_error("cannot resize with pending tasks");
         }
-
-        this->wait();
-        if (workers_.size() > 0) {
-            task_manager_.stop();
-            join_threads();
-            workers_.clear();
+        num_queues_ = std::max(num_queues, static_cast<size_t>(1));
+        if (num_queues_ > queues_.size()) {
+            queues_ = mem::aligned::vector<TaskQueue>(num_queues_);
+            deques_ = mem::aligned::vector<WorkerDeque>(num_queues_);
+            lanes_ = mem::aligned::vector<InjectionQueue>(num_queues_);
+            // thread pool must have stopped the manager, reset
+            num_waiting_ = 0;
+            todo_ = 0;
+            status_ = Status::running;
         }
+    }
 
-        task_manager_ = quickpool::sched::TaskManager{ threads };
-        workers_ = std::vector<std::thread>{ threads };
-        for (size_t id = 0; id < threads; ++id) {
-            add_worker(id);
+    //! index of the calling worker if it works for this manager; the maximal
+    //! `size_t` otherwise.
+    size_t own_worker() const
+    {
+        if (this_worker_owner() != this) {
+            return std::numeric_limits<size_t>::max();
         }
-#if (defined __linux__)
-        if (threads > 0) {
-            set_thread_affinity();
+        return this_worker_id();
+    }
+
+    //! pushes a task without locking. Workers push to their own deque, other
+    //! threads to the injection lanes in round robin order.
+    template<typename Task>
+    void push(Task&& task)
+    {
+        rethrow_exception(); // push() throws if a task has errored.
+        if (is_running()) {
+            this->enqueue(std::forward<Task>(task), false);
         }
-#endif
-        active_threads_ = threads;
     }
 
-    //! @brief retrieves the number of active worker threads in the thread pool.
-    size_t get_active_threads() const { return active_threads_; }
+    //! pushes a task to queue `idx` (modulo the number of queues). Workers
+    //! pop from their own queue first, so the task likely runs on worker
+    //! `idx`.
+    template<typename Task>
+    void push(Task&& task, size_t idx)
+    {
+        rethrow_exception(); // push() throws if a task has errored.
+        if (is_running()) {
+            this->enqueue_to(std::forward<Task>(task), idx, false);
+        }
+    }
 
-    //! @brief pushes a job to the thread pool.
-    //! @param f a function.
-    //! @param args (optional) arguments passed to `f`.
-    template<class Function, class... Args>
-    void push(Function&& f, Args&&... args)
+    //! pushes a task whose completion is tracked elsewhere, e.g., by the
+    //! latch of a task group or the state of a future. Unlike `push()`, it
+    //! doesn't throw errors of other tasks, and the task is never thrown
+    //! away: if the pool isn't running, the calling thread runs the task
+    //! right away. The task must handle its own exceptions.
+    template<typename Task>
+    void push_tracked(Task&& task)
     {
-        if (active_threads_ == 0) {
-            std::forward<Function>(f)(std::forward<Args>(args)...);
-            return;
+        if (is_running()) {
+            this->enqueue(std::forward<Task>(task), true);
+        } else {
+            task();
         }
-        task_manager_.push(detail::Task<Function, Args...>::make(
-          std::forward<Function>(f), std::forward<Args>(args)...));
     }
 
-    //! @brief executes a job asynchronously on the global thread pool.
-    //! @param f a function.
-    //! @param args (optional) arguments passed to `f`.
-    //! @return A `std::future` for the task. Call `future.get()` to
-    //! retrieve the results at a later point in time (blocking).
-    template<class Function, class... Args>
-    auto async(Function&& f, Args&&... args)
-      -> std::future<typename detail::Task<Function, Args...>::type>
+    //! pushes a tracked task to queue `idx`, see `push_tracked(task)` and
+    //! `push(task, idx)`.
+    template<typename Task>
+    void push_tracked(Task&& task, size_t idx)
     {
-        auto pack = detail::Task<Function, Args...>::make(
-          std::forward<Function>(f), std::forward<Args>(args)...);
-        using result_t = typename detail::Task<Function, Args...>::type;
-        using pack_t = std::packaged_task<result_t()>;
-        auto task_ptr = std::make_shared<pack_t>(std::move(pack));
-        this->push([task_ptr] { (*task_ptr)(); });
-        return task_ptr->get_future();
+        if (is_running()) {
+            this->enqueue_to(std::forward<Task>(task), idx, true);
+        } else {
+            task();
+        }
     }
 
-    //! @brief computes an index-based parallel for loop.
-    //!
-    //! Waits until all tasks have finished, unless called from a thread
-    //! that didn't create the pool. If this is taken into account, parallel
-    //! loops can be nested.
-    //!
-    //! @param begin first index of the loop.
-    //! @param end the loop runs in the range `[begin, end)`.
-    //! @param f a function taking `int` argument (the 'loop body').
-    template<class UnaryFunction>
-    void parallel_for(int begin, int end, UnaryFunction f)
+    //! pushes the tasks `make(0), ..., make(n - 1)`; `make` is called in
+    //! this order. The tasks are split into one contiguous batch per queue
+    //! (at most `n` queues), so every queue is locked once and sleepers are
+    //! woken up once.
+    template<class Make>
+    void push_n(size_t n, Make&& make)
     {
-        if (end <= begin) {
+        rethrow_exception(); // push() throws if a task has errored.
+        if (n == 0 || !is_running()) {
             return;
         }
-        const auto active_threads = active_threads_.load(mem::relaxed);
-        if (active_threads == 0) {
-            for (auto i = begin; i < end; ++i) {
-                f(i);
+        // see wake_sleeper()
+        todo_.fetch_add(static_cast<int>(n), mem::seq_cst);
+        const auto batches = std::min(n, num_queues_);
+        const size_t first = push_idx_.fetch_add(batches, mem::relaxed);
+        size_t pushed = 0;
+        try {
+            for (size_t k = 0; k < batches; ++k) {
+                const auto begin = k * n / batches;
+                const auto end = (k + 1) * n / batches;
+                queues_[(first + k) % num_queues_].push_n(
+                  end - begin,
+                  [&](size_t i) { return make(begin + i); },
+                  pushed);
             }
-            return;
+        } catch (...) {
+            report_success(n - pushed);
+            this->wake_sleeper(std::min(pushed, batches));
+            throw;
+        }
+        // one worker per batch
+        this->wake_sleeper(batches);
+    }
+
+    //! pops a task. Workers first pop the most recent task of their own
+    //! deque, then scan the lanes and queues and steal from the other
+    //! deques, starting at `worker_id`.
+    template<typename Task>
+    bool try_pop(Task& task, size_t worker_id = 0)
+    {
+        const auto own = this->own_worker();
+        bool tracked = false;
+        if (own < num_queues_ && deques_[own].pop(task, tracked)) {
+            return this->check_running(tracked);
+        }
+
+        // Always start pop cycle at own queue to avoid contention.
+        for (size_t k = 0; k < num_queues_; k++) {
+            const auto idx = (worker_id + k) % num_queues_;
+            if (lanes_[idx].pop(task, tracked) ||
+                queues_[idx].try_pop(task, tracked) ||
+                (idx != own && deques_[idx].steal(task, tracked))) {
+                return this->check_running(tracked);
+            }
+        }
+
+        return false;
+    }
+
+    //! publishes a job for `tickets` workers and wakes up sleeping workers;
+    //! returns false if another job is published already.
+    bool publish(Broadcast& job, size_t tickets)
+    {
+        Broadcast* none = nullptr;
+        if (!is_running() || !board_.compare_exchange_strong(none, &job)) {
+            return false;
+        }
+        todo_.fetch_add(static_cast<int>(tickets), mem::release);
+        job.tickets.store(tickets, mem::release);
+        this->wake_sleeper(tickets);
+        return true;
+    }
+
+    //! withdraws a published job; returns the number of unclaimed tickets.
+    size_t retract(Broadcast& job)
+    {
+        const auto unclaimed = job.close();
+        if (unclaimed > 0) {
+            auto expected = &job;
+            board_.compare_exchange_strong(expected, nullptr);
+            this->report_success(unclaimed);
+        }
+        return unclaimed;
+    }
+
+    //! claims a ticket of the published job and runs it; returns false if
+    //! there's nothing to claim.
+    bool try_join()
+    {
+        auto job = board_.load(mem::acquire);
+        size_t ticket;
+        if (!job || !job->claim(ticket)) {
+            return false;
+        }
+        if (ticket == 0) {
+            // claimed the last ticket, make room for the next job
+            board_.compare_exchange_strong(job, nullptr);
+        }
+        job->run(*job, ticket);
+        this->report_success();
+        return true;
+    }
+
+    void wait_for_jobs()
+    {
+        if (has_errored()) {
+            // Main thread may be waiting to reset the pool.
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (++num_waiting_ == queues_.size())
+                cv_.notify_all();
+        } else {
+            ++num_waiting_;
+        }
+
+        auto woken = [this] {
+            return stopped() || board_.load() != nullptr || todo_.load() > 0;
+        };
+        if (!this->spin_until(woken)) {
+            // Sleepers announce themselves before checking for pending work
+            // (see wake_sleeper()).
+            while (true) {
+                const auto key = idle_.prepare_wait();
+                if (woken()) {
+                    idle_.cancel_wait();
+                    break;
+                }
+                idle_.commit_wait(key);
+            }
+        }
+        --num_waiting_;
+    }
+
+    //! sets how workers wait for new tasks; workers already waiting pick up
+    //! the new policy unless they are parked.
+    void set_idle_policy(IdlePolicy policy) { idle_policy_ = policy; }
+
+    IdlePolicy get_idle_policy() const { return idle_policy_.load(); }
+
+    //! @param millis if > 0: stops waiting after millis ms
+    void wait_for_finish(size_t millis = 0)
+    {
+        if (called_from_owner_thread() && is_running()) {
+            auto wake_up = [this] { return (todo_ <= 0) || !is_running(); };
+            std::unique_lock<std::mutex> lk(mtx_);
+            if (millis == 0) {
+                cv_.wait(lk, wake_up);
+            } else {
+                cv_.wait_for(lk, std::chrono::milliseconds(millis), wake_up);
+            }
+        }
+        rethrow_exception();
+    }
+
+    bool called_from_owner_thread() const
+    {
+        return (std::this_thread::get_id() == owner_id_);
+    }
+
+    void report_success(size_t count = 1)
+    {
+        const auto c = static_cast<int>(count);
+        auto n = todo_.fetch_sub(c, mem::release) - c;
+        if (n == 0) {
+            // all jobs are done; lock before signal to prevent spurious
+            // failure
+            {
+                std::lock_guard<std::mutex> lk{ mtx_ };
+            }
+            cv_.notify_all();
+        }
+    }
+
+    void report_fail(std::exception_ptr err_ptr)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (has_errored()) // only catch first exception
+            return;
+        err_ptr_ = err_ptr;
+        status_ = Status::errored;
+
+        // Some threads may change todo_ after we stop. The large
+        // negative number forces them to exit the processing loop.
+        todo_.store(std::numeric_limits<int>::min() / 2);
+        cv_.notify_all();
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            status_ = Status::stopped;
+        }
+        this->wake_sleeper(std::numeric_limits<size_t>::max());
+    }
+
+    void rethrow_exception()
+    {
+        // Exceptions are only thrown from the owner thread, not in workers.
+        if (called_from_owner_thread() && has_errored()) {
+            {
+                // Wait for all threads to idle so we can clean up after
+                // them.
+                std::unique_lock<std::mutex> lk(mtx_);
+                cv_.wait(lk, [this] { return num_waiting_ == queues_.size(); });
+            }
+            // Before throwing: restore defaults for potential future use of
+            // the task manager.
+            todo_ = 0;
+            auto current_exception = err_ptr_;
+            err_ptr_ = nullptr;
+            status_ = Status::running;
+
+            std::rethrow_exception(current_exception);
+        }
+    }
+
+    bool is_running() const
+    {
+        return status_.load(mem::relaxed) == Status::running;
+    }
+
+    bool has_errored() const
+    {
+        return status_.load(mem::relaxed) == Status::errored;
+    }
+
+    bool stopped() const
+    {
+        return status_.load(mem::relaxed) == Status::stopped;
+    }
+
+    bool done() const { return (todo_.load(mem::relaxed) <= 0); }
+
+  private:
+    //! pushes a task to the deque of the calling worker or, from other
+    //! threads, to an injection lane.
+    //! @param tracked see `push_tracked()`.
+    template<typename Task>
+    void enqueue(Task&& task, bool tracked)
+    {
+        const auto id = this->own_worker();
+        if (id < num_queues_) {
+            this->push_own(std::forward<Task>(task), id, tracked);
+        } else {
+            this->inject(std::forward<Task>(task), tracked);
+        }
+    }
+
+    //! pushes a task to queue `idx` (modulo the number of queues).
+    template<typename Task>
+    void enqueue_to(Task&& task, size_t idx, bool tracked)
+    {
+        todo_.fetch_add(1, mem::seq_cst); // see wake_sleeper()
+        try {
+            queues_[idx % num_queues_].push(task, tracked);
+        } catch (...) {
+            report_success();
+            throw;
+        }
+        this->wake_sleeper();
+    }
+
+    //! pushes a task to the deque of worker `id`, which must be the caller.
+    template<typename Task>
+    void push_own(Task&& task, size_t id, bool tracked)
+    {
+        todo_.fetch_add(1, mem::seq_cst); // see wake_sleeper()
+        try {
+            deques_[id].push(task, tracked);
+        } catch (...) {
+            report_success();
+            throw;
+        }
+        this->wake_sleeper();
+    }
+
+    //! pushes a task from outside the pool to the next lane of the calling
+    //! thread. If the lane is full, the task goes to the lane's queue.
+    template<typename Task>
+    void inject(Task&& task, bool tracked)
+    {
+        const auto idx = next_lane() % num_queues_;
+        std::function<void()> f(std::forward<Task>(task));
+        todo_.fetch_add(1, mem::seq_cst); // see wake_sleeper()
+        if (!lanes_[idx].push(f, tracked)) {
+            try {
+                queues_[idx].push(std::move(f), tracked);
+            } catch (...) {
+                report_success();
+                throw;
+            }
+        }
+        this->wake_sleeper();
+    }
+
+    //! spins until `woken()` returns true, as long as the idle policy allows;
+    //! returns false if the worker should park instead.
+    template<class Predicate>
+    bool spin_until(Predicate&& woken) const
+    {
+        // The spin policy backs off up to 64 pauses per round and gives up
+        // after about 500 pauses (a few to tens of microseconds).
+        for (size_t round = 0;; ++round) {
+            const auto policy = idle_policy_.load(mem::relaxed);
+            if (policy == IdlePolicy::block ||
+                (policy == IdlePolicy::spin && round >= 12)) {
+                return false;
+            }
+            if (woken()) {
+                return true;
+            }
+            auto pauses = static_cast<size_t>(1);
+            if (policy == IdlePolicy::spin) {
+                pauses <<= std::min(round, static_cast<size_t>(6));
+            }
+            for (size_t i = 0; i < pauses; ++i) {
+                cpu_relax();
+            }
+        }
+    }
+
+    //! wakes up `n` sleeping workers, if any. Whichever worker wakes up
+    //! scans all queues, so it doesn't matter where the work is.
+    void wake_sleeper(size_t n = 1)
+    {
+        // Sleepers announce themselves before checking `todo_`. Both sides
+        // are sequentially consistent, so either they see the new work or
+        // we see them.
+        idle_.notify(n);
+    }
+
+    //! checks whether a popped task should run; throws away untracked tasks
+    //! if the pool has stopped or errored, but counts them as done so that
+    //! workers can leave. Tracked tasks always run (see `push_tracked()`).
+    bool check_running(bool tracked)
+    {
+        if (tracked || is_running()) {
+            return true;
+        }
+        report_success();
+        return false;
+    }
+
+    //! worker queues
+    mem::aligned::vector<TaskQueue> queues_;
+
+    //! worker deques for tasks pushed by workers
+    mem::aligned::vector<WorkerDeque> deques_;
+
+    //! injection lanes for tasks pushed by other threads
+    mem::aligned::vector<InjectionQueue> lanes_;
+    size_t num_queues_;
+
+    //! parks idle workers
+    EventCount idle_;
+    mem::aligned::atomic<IdlePolicy> idle_policy_;
+
+    //! task management
+    mem::aligned::relaxed_atomic<size_t> num_waiting_{ 0 };
+    mem::aligned::relaxed_atomic<size_t> push_idx_{ 0 };
+    mem::aligned::atomic<int> todo_{ 0 };
+
+    //! job published to all workers, see `publish()`
+    mem::aligned::atomic<Broadcast*> board_{ nullptr };
+
+    //! synchronization variables
+    const std::thread::id owner_id_;
+    enum class Status
+    {
+        running,
+        errored,
+        stopped
+    };
+    mem::aligned::atomic<Status> status_{ Status::running };
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::exception_ptr err_ptr_{ nullptr };
+};
+
+// find out which cores are allowed for use by pthread
+inline std::vector<size_t>
+get_avail_cores()
+{
+    auto ncores = std::thread::hardware_concurrency();
+    std::vector<size_t> avail_cores;
+    avail_cores.reserve(ncores);
+#if (defined __linux__)
+    cpu_set_t cpuset;
+    int rc = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    if (rc != 0) {
+        throw std::runtime_error("Error calling pthread_getaffinity_np");
+    }
+    for (size_t id = 0; id < ncores; id++) {
+        if (CPU_ISSET(id, &cpuset)) {
+            avail_cores.push_back(id);
+        }
+    }
+#endif
+    return avail_cores;
+}
+
+inline size_t
+num_cores_avail()
+{
+#if (defined __linux__)
+    return get_avail_cores().size();
+#endif
+    return std::thread::hardware_concurrency();
+}
+
+} // end namespace sched
+
+// 4. ------------------------------------------------------------------------
+
+class ThreadPool;
+
+template<class T>
+class Future;
+
+//! @brief Result of `when_any()`: all futures passed to it and the index of
+//! one that is ready.
+template<class T>
+struct WhenAny
+{
+    size_t index;
+    std::vector<Future<T>> futures;
+};
+
+namespace sched {
+
+//! Reference counted node of a graph of futures: a shared state or something
+//! waiting for one (a continuation or combinator).
+class FutureNode
+{
+  public:
+    virtual ~FutureNode() = default;
+
+    //! does the work of the node; takes over one reference.
+    virtual void run() { this->release(); }
+
+    //! called once a state the node was attached to is ready; takes over the
+    //! reference added by `attach()`.
+    virtual void notify() { this->release(); }
+
+    void retain() { refs_.fetch_add(1, mem::relaxed); }
+
+    void release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+  private:
+    std::atomic<size_t> refs_{ 1 };
+};
+
+//! runs `node` on `pool` (inline if the pool has no active threads).
+inline void
+schedule(ThreadPool& pool, FutureNode* node);
+
+#if QUICKPOOL_HAS_COROUTINES
+//! resumes a coroutine on `pool`: the coroutine is pushed to the queue of
+//! the calling worker, where other workers may steal it (inline if the pool
+//! has no active threads).
+inline void
+resume(ThreadPool& pool, std::coroutine_handle<> handle);
+
+//! waits for `latch`. Pool workers run queued tasks of their own pool in the
+//! meantime, so they don't block work queued behind them.
+inline void
+wait_for(Latch& latch);
+
+//! Resumes a coroutine once the future state it is attached to is ready.
+class ResumeNode : public FutureNode
+{
+  public:
+    ResumeNode(ThreadPool* pool, std::coroutine_handle<> handle)
+      : pool_{ pool }
+      , handle_{ handle }
+    {}
+
+    void notify() override
+    {
+        resume(*pool_, handle_);
+        this->release();
+    }
+
+  private:
+    ThreadPool* pool_;
+    std::coroutine_handle<> handle_;
+};
+#endif
+
+//! Placeholder value of futures without value.
+struct Empty
+{};
+
+//! Shared state of a future: the value or exception and at most one node
+//! waiting for it. Everything lives in one allocation together with the work
+//! producing the value (see derived classes).
+template<class T>
+class FutureState : public FutureNode
+{
+  public:
+    using Value =
+      typename std::conditional<std::is_void<T>::value, Empty, T>::type;
+
+    explicit FutureState(ThreadPool* pool)
+      : pool_{ pool }
+    {}
+
+    ~FutureState() override
+    {
+        if (has_value_) {
+            reinterpret_cast<Value*>(&storage_)->~Value();
+        }
+    }
+
+    ThreadPool* pool() const { return pool_; }
+
+    bool is_ready() const { return waiter_.load(mem::acquire) == ready(); }
+
+    //! sets a value; only once and only if no error was set.
+    void set_value(Value&& value)
+    {
+        new (&storage_) Value(std::move(value));
+        has_value_ = true;
+        this->finish();
+    }
+
+    //! sets an exception; only once and only if no value was set.
+    void set_error(std::exception_ptr error)
+    {
+        error_ = error;
+        this->finish();
+    }
+
+    //! notifies `waiter` once the state is ready (immediately if it is);
+    //! only one node may be attached.
+    void attach(FutureNode* waiter)
+    {
+        waiter->retain();
+        FutureNode* none = nullptr;
+        if (!waiter_.compare_exchange_strong(
+              none, waiter, std::memory_order_acq_rel)) {
+            waiter->notify();
+        }
+    }
+
+    //! the exception; call only once ready.
+    std::exception_ptr error() const { return error_; }
+
+    //! moves the value out or rethrows the exception; call only once ready.
+    Value take()
+    {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return std::move(*reinterpret_cast<Value*>(&storage_));
+    }
+
+    //! counts down once the state is ready; blocking waiters wait on it.
+    Latch& latch() { return latch_; }
+
+  private:
+    //! tag stored in `waiter_` once the state is ready.
+    static FutureNode* ready()
+    {
+        return reinterpret_cast<FutureNode*>(std::uintptr_t(1));
+    }
+
+    void finish()
+    {
+        auto waiter = waiter_.exchange(ready(), std::memory_order_acq_rel);
+        latch_.count_down();
+        if (waiter) {
+            waiter->notify();
+        }
+    }
+
+    ThreadPool* pool_;
+    std::atomic<FutureNode*> waiter_{ nullptr };
+    typename std::aligned_storage<sizeof(Value), alignof(Value)>::type storage_;
+    bool has_value_{ false };
+    std::exception_ptr error_{ nullptr };
+    Latch latch_{ 1 };
+};
+
+//! Calls a function and returns its result as the value of a future state
+//! (`Empty` for functions returning `void`).
+template<class R>
+struct Call
+{
+    template<class Function, class... Args>
+    static R call(Function& f, Args&&... args)
+    {
+        return f(std::forward<Args>(args)...);
+    }
+};
+
+template<>
+struct Call<void>
+{
+    template<class Function, class... Args>
+    static Empty call(Function& f, Args&&... args)
+    {
+        f(std::forward<Args>(args)...);
+        return Empty{};
+    }
+};
+
+//! Result type of a continuation `f` of a `Future<T>`.
+template<class T, class Function>
+struct Then
+{
+    using type = decltype(std::declval<Function&>()(std::declval<T>()));
+};
+
+template<class Function>
+struct Then<void, Function>
+{
+    using type = decltype(std::declval<Function&>()());
+};
+
+//! State of a future computed by a task pushed to the pool.
+template<class T, class Task>
+class TaskState : public FutureState<T>
+{
+  public:
+    TaskState(ThreadPool* pool, Task&& task)
+      : FutureState<T>(pool)
+      , task_{ std::move(task) }
+    {}
+
+    void run() override
+    {
+        try {
+            this->set_value(Call<T>::call(task_));
+        } catch (...) {
+            this->set_error(std::current_exception());
+        }
+        this->release();
+    }
+
+  private:
+    Task task_;
+};
+
+} // end namespace sched
+
+//! @brief The result of an asynchronous computation on a thread pool.
+//!
+//! A lightweight alternative to `std::future`: the state shared with the
+//! task lives in a single allocation, and `then()` chains work that runs on
+//! the pool once the value is ready, without blocking a thread. Waiting
+//! threads run queued tasks in the meantime. Futures are move-only and
+//! consumed by `get()` and `then()`.
+template<class T>
+class Future
+{
+  public:
+    //! @brief creates a future without state.
+    Future() = default;
+
+    ~Future()
+    {
+        if (state_) {
+            state_->release();
+        }
+    }
+
+    Future(Future&& other) noexcept
+      : state_{ other.state_ }
+    {
+        other.state_ = nullptr;
+    }
+
+    Future& operator=(Future&& other) noexcept
+    {
+        std::swap(state_, other.state_);
+        return *this;
+    }
+
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    //! @brief checks whether the future has a state, i.e., wasn't
+    //! default-constructed or consumed.
+    bool valid() const { return state_ != nullptr; }
+
+    //! @brief checks whether the value (or an exception) is available.
+    bool is_ready() const { return state_->is_ready(); }
+
+    //! @brief waits until the value is available.
+    void wait();
+
+    //! @brief waits for the value and returns it; rethrows the exception
+    //! thrown by the computation. Consumes the future.
+    T get();
+
+    //! @brief schedules `f` to run on the pool once the value is ready.
+    //!
+    //! `f` is called with the value (without arguments for `Future<void>`).
+    //! If the computation has thrown, `f` is skipped and the returned future
+    //! holds the exception. Consumes the future.
+    //! @return a future for the result of `f`.
+    template<class Function>
+    auto then(Function&& f)
+      -> Future<typename sched::Then<T, typename std::decay<Function>::type>::type>;
+
+#if QUICKPOOL_HAS_COROUTINES
+    //! @brief `co_await future` suspends the coroutine until the value is
+    //! ready and resumes it on the pool; consumes the future.
+    auto operator co_await() && noexcept { return Awaiter{ std::move(*this) }; }
+#endif
+
+  private:
+    template<class U>
+    friend class Future;
+    template<class U>
+    friend Future<std::vector<Future<U>>> when_all(std::vector<Future<U>>);
+    template<class U>
+    friend Future<WhenAny<U>> when_any(std::vector<Future<U>>);
+    friend class ThreadPool;
+
+    explicit Future(sched::FutureState<T>* state)
+      : state_{ state }
+    {}
+
+#if QUICKPOOL_HAS_COROUTINES
+    struct Awaiter
+    {
+        bool await_ready() const noexcept { return future.is_ready(); }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            auto state = future.state_;
+            auto node = new sched::ResumeNode(state->pool(), handle);
+            state->attach(node);
+            node->release();
+        }
+
+        T await_resume() { return future.get(); }
+
+        Future future;
+    };
+#endif
+
+    sched::FutureState<T>* state_{ nullptr };
+};
+
+//! @brief Affinity partitioner for parallel loops that run repeatedly over
+//! the same range.
+//!
+//! Records which pool worker executed the initial subrange of each loop
+//! worker and hands the subrange to the same pool worker on later calls, so
+//! it finds its data in cache. Work stealing still balances the load. A
+//! partitioner must not be used by two loops at the same time.
+class AffinityPartitioner
+{
+  public:
+    //! @param grain_size number of indices processed per chunk; 0 (default)
+    //! selects the chunk size automatically.
+    explicit AffinityPartitioner(size_t grain_size = 0)
+      : grain_size_{ grain_size }
+    {}
+
+    //! @brief returns the grain size used for loops.
+    size_t grain_size() const { return grain_size_; }
+
+  private:
+    friend class ThreadPool;
+
+    //! Assignment of loop workers to pool workers for a single loop.
+    //!
+    //! Tasks may be popped by other pool workers than the one they were
+    //! pushed to. Tasks are therefore not tied to a loop worker; a task
+    //! claims the loop worker that its pool worker ran last time, if that's
+    //! still available.
+    struct Loop
+    {
+        Loop(const std::vector<size_t>& workers, size_t num_threads)
+          : workers{ workers }
+          , preferred(num_threads, workers.size())
+          , claimed{ new std::atomic_bool[workers.size()]() }
+          , executed{ new std::atomic<size_t>[workers.size()] }
+        {
+            for (size_t k = 0; k < workers.size(); ++k) {
+                if (workers[k] < num_threads) {
+                    preferred[workers[k]] = k;
+                }
+                executed[k] = workers[k];
+            }
+        }
+
+        //! claims a loop worker for pool worker `id`.
+        size_t claim(size_t id)
+        {
+            if (id < preferred.size() && preferred[id] < workers.size() &&
+                !claimed[preferred[id]].exchange(true)) {
+                return preferred[id];
+            }
+            for (size_t k = 0; k < workers.size(); ++k) {
+                if (!claimed[k].load() && !claimed[k].exchange(true)) {
+                    return k;
+                }
+            }
+            return workers.size(); // unreachable, one task per loop worker
+        }
+
+        //! records the pool worker executing loop worker `k`.
+        void record(size_t k, size_t id) { executed[k] = id; }
+
+        std::vector<size_t> workers;   //!< pool worker of each loop worker
+        std::vector<size_t> preferred; //!< loop worker of each pool worker
+        std::unique_ptr<std::atomic_bool[]> claimed;
+        std::unique_ptr<std::atomic<size_t>[]> executed;
+    };
+
+    //! prepares a loop with `num_workers` loop workers on `pool`; forgets
+    //! all recorded workers if either changed.
+    std::shared_ptr<Loop> start(const ThreadPool* pool,
+                                size_t num_workers,
+                                size_t num_threads)
+    {
+        if (pool != pool_ || num_workers != workers_.size()) {
+            pool_ = pool;
+            workers_.assign(num_workers, std::numeric_limits<size_t>::max());
+        }
+        return std::make_shared<Loop>(workers_, num_threads);
+    }
+
+    //! stores the assignment of a finished loop. Tasks starting after the
+    //! loop finished only modify the `Loop` object.
+    void finish(const Loop& loop)
+    {
+        for (size_t k = 0; k < workers_.size(); ++k) {
+            workers_[k] = loop.executed[k];
+        }
+    }
+
+    size_t grain_size_;
+    const ThreadPool* pool_{ nullptr };
+    std::vector<size_t> workers_;
+};
+
+//! @brief Adaptive partitioner for parallel loops that are often too small
+//! to run in parallel.
+//!
+//! Learns how long the loop body takes per index. Loops that are too small
+//! to pay for waking other threads run on the calling thread alone, larger
+//! loops only wake as many workers as the work is worth. While the cost is
+//! unknown, the calling thread starts alone and measures. A partitioner
+//! should be kept for repeated calls of the same loop, e.g., as a `static`
+//! variable at the call site; it may be used by several loops at once.
+class AdaptivePartitioner
+{
+  public:
+    //! @param grain_size maximal number of indices per chunk; 0 (default)
+    //! selects the chunk size automatically.
+    explicit AdaptivePartitioner(size_t grain_size = 0)
+      : grain_size_{ grain_size }
+    {}
+
+    //! @brief returns the grain size used for loops.
+    size_t grain_size() const { return grain_size_; }
+
+  private:
+    friend class ThreadPool;
+
+    size_t grain_size_;
+    loop::Cost cost_;
+};
+
+//! @brief Spawns tasks on a thread pool and waits for them (fork-join).
+//!
+//! Tasks are pushed to the queue of the calling worker, so child tasks of
+//! recursive algorithms run close to their parent. `sync()` waits only for
+//! the tasks spawned by this object. The waiting thread runs queued tasks in
+//! the meantime, so fork-join scopes can be nested from any thread.
+class ForkJoin
+{
+  public:
+    //! @brief creates a scope spawning tasks on the global thread pool.
+    ForkJoin();
+
+    //! @brief creates a scope spawning tasks on `pool`.
+    explicit ForkJoin(ThreadPool& pool);
+
+    //! @brief waits for all spawned tasks; exceptions are discarded.
+    ~ForkJoin();
+
+    ForkJoin(const ForkJoin&) = delete;
+    ForkJoin& operator=(const ForkJoin&) = delete;
+
+    //! @brief spawns a task running `f()`.
+    //!
+    //! Once a spawned task has thrown, tasks that haven't started yet are
+    //! skipped.
+    //! @param f a function without arguments.
+    template<class Function>
+    void spawn(Function&& f);
+
+    //! @brief waits for all spawned tasks and rethrows the first exception
+    //! thrown by one of them.
+    void sync();
+
+  private:
+    //! runs a spawned task unless one has thrown before.
+    template<class Function>
+    static void run(sched::Latch& latch, Function& f)
+    {
+        if (!latch.has_errored()) {
+            try {
+                f();
+            } catch (...) {
+                latch.report_fail(std::current_exception());
+            }
+        }
+        latch.count_down();
+    }
+
+    ThreadPool& pool_;
+    sched::Latch latch_{ 0 };
+};
+
+//! @brief A group of tasks that can be waited for and cancelled together.
+//!
+//! Unlike `ThreadPool::wait()`, `wait()` only waits for the tasks of this
+//! group and can be called from any thread. The waiting thread runs queued
+//! tasks in the meantime. Several groups can share a pool without affecting
+//! each other.
+class TaskGroup
+{
+  public:
+    //! @brief creates a group of tasks for the global thread pool.
+    TaskGroup();
+
+    //! @brief creates a group of tasks for `pool`.
+    explicit TaskGroup(ThreadPool& pool);
+
+    //! @brief waits for all tasks of the group; exceptions are discarded.
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    //! @brief pushes a task running `f(args...)` to the pool.
+    //! @param f a function.
+    //! @param args (optional) arguments passed to `f`.
+    template<class Function, class... Args>
+    void push(Function&& f, Args&&... args);
+
+    //! @brief waits for all tasks of the group and rethrows the first
+    //! exception thrown by one of them. Afterwards, the group can be used
+    //! again, also if it was cancelled.
+    void wait();
+
+    //! @brief cancels the group: tasks that haven't started yet are dropped,
+    //! running tasks finish. The first exception thrown by a task cancels the
+    //! group, too.
+    void cancel() { cancelled_ = true; }
+
+    //! @brief checks whether the group is cancelled; long running tasks may
+    //! poll this to stop early.
+    bool is_cancelled() const
+    {
+        return cancelled_.load(mem::relaxed) || latch_.has_errored();
+    }
+
+#if QUICKPOOL_HAS_COROUTINES
+    //! @brief `co_await group` suspends the coroutine until all tasks of the
+    //! group have finished and resumes it on the pool; behaves like
+    //! `wait()` otherwise.
+    auto operator co_await() noexcept { return Awaiter{ this, nullptr, {} }; }
+#endif
+
+  private:
+#if QUICKPOOL_HAS_COROUTINES
+    struct Awaiter
+    {
+        bool await_ready() const noexcept { return group->latch_.done(); }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            handle = h;
+            waiter = { &Awaiter::resume, this, nullptr };
+            return group->latch_.on_done(waiter);
+        }
+
+        void await_resume()
+        {
+            group->latch_.wait();
+            group->rearm();
+        }
+
+        static void resume(void* self)
+        {
+            auto awaiter = static_cast<Awaiter*>(self);
+            sched::resume(awaiter->group->pool_, awaiter->handle);
+        }
+
+        TaskGroup* group;
+        std::coroutine_handle<> handle;
+        sched::Latch::Waiter waiter;
+    };
+#endif
+
+    //! clears the cancellation and rethrows the first exception; call once
+    //! all tasks have finished.
+    void rearm();
+
+    //! runs a task unless the group is cancelled.
+    template<class Task>
+    static void run(TaskGroup& group, Task& task)
+    {
+        if (!group.is_cancelled()) {
+            try {
+                task();
+            } catch (...) {
+                group.latch_.report_fail(std::current_exception());
+            }
+        }
+        group.latch_.count_down();
+    }
+
+    ThreadPool& pool_;
+    sched::Latch latch_{ 0 };
+    std::atomic_bool cancelled_{ false };
+};
+
+//! @brief A graph of tasks with dependencies that can be run repeatedly.
+//!
+//! Nodes and edges are declared once; `run()` then runs every node after
+//! all its predecessors have finished. Each node counts its unfinished
+//! predecessors atomically. The worker finishing the last predecessor of a
+//! node runs it next or pushes it to its own queue, so data flows along
+//! the graph on the same thread where possible. Running a graph again
+//! doesn't allocate.
+class TaskGraph
+{
+  public:
+    //! @brief creates an empty graph running on the global thread pool.
+    TaskGraph();
+
+    //! @brief creates an empty graph running on `pool`.
+    explicit TaskGraph(ThreadPool& pool);
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    //! @brief adds a node running `f()`.
+    //! @param f a function without arguments.
+    //! @return the id of the node, which counts up from 0.
+    template<class Function>
+    size_t add(Function&& f);
+
+    //! @brief declares that node `after` starts only once node `before` has
+    //! finished.
+    void precede(size_t before, size_t after);
+
+    //! @brief number of nodes in the graph.
+    size_t size() const { return nodes_.size(); }
+
+    //! @brief runs all nodes and waits for them; rethrows the first exception
+    //! thrown by a node. Once a node has thrown, nodes that haven't started
+    //! yet are skipped. A graph must not be run by two threads at once.
+    //! @throws std::invalid_argument if the edges contain a cycle.
+    void run();
+
+  private:
+    struct Node
+    {
+        std::function<void()> f;
+        std::vector<size_t> successors;
+        size_t predecessors{ 0 };
+    };
+
+    //! sorts the nodes topologically and sizes the counters after the graph
+    //! has changed.
+    void prepare();
+
+    //! runs `node` and then, on the same thread, one of the successors it
+    //! releases; the others are pushed to the pool.
+    void execute(size_t node);
+
+    //! runs `node` on the pool.
+    void spawn(size_t node);
+
+    ThreadPool& pool_;
+    std::vector<Node> nodes_;
+    std::vector<size_t> order_;
+    size_t sources_{ 0 };
+    std::unique_ptr<std::atomic<size_t>[]> pending_;
+    bool prepared_{ false };
+    sched::Latch latch_{ 0 };
+};
+
+//! A work stealing thread pool.
+class ThreadPool
+{
+  public:
+    //! @brief constructs a thread pool.
+    //! @param threads number of worker threads to create; defaults to
+    //! number of available (virtual) hardware cores.
+    //! @param idle_policy how workers wait for new tasks, see
+    //! `set_idle_policy()`.
+    explicit ThreadPool(size_t threads = sched::num_cores_avail(),
+                        IdlePolicy idle_policy = IdlePolicy::block)
+      : task_manager_{ threads, idle_policy }
+    {
+        set_active_threads(threads);
+    }
+
+    ~ThreadPool()
+    {
+        task_manager_.stop();
+        join_threads();
+    }
+
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool& operator=(ThreadPool&& other) = delete;
+
+    //! @brief returns a reference to the global thread pool instance.
+    static ThreadPool& global_instance()
+    {
+#ifdef _WIN32
+        // Must leak resource, because windows + R deadlock otherwise.
+        // Memory is released on shutdown.
+        static auto ptr = new ThreadPool;
+        return *ptr;
+#else
+        static ThreadPool instance_;
+        return instance_;
+#endif
+    }
+
+    //! @brief sets the number of active worker threads in the thread pool.
+    //! @param threads the number of worker threads.
+    //! Has no effect when not called from owner thread.
+    void set_active_threads(size_t threads)
+    {
+        if (!task_manager_.called_from_owner_thread())
+            return;
+
+        if (threads == active_threads_.load(mem::relaxed)) {
+            return;
         }
 
-        // each worker has its dedicated range, but can steal part of
-        // another worker's ranges when done with own
-        const auto num_tasks = static_cast<size_t>(end - begin);
-        const auto n =
-          std::min(std::max(active_threads, static_cast<size_t>(1)), num_tasks);
-        auto workers = loop::create_workers<UnaryFunction>(f, begin, end, n);
-        for (size_t k = 0; k < n; k++) {
-            this->push([=] { workers->at(k).run(workers); });
-        }
         this->wait();
+        if (workers_.size() > 0) {
+            task_manager_.stop();
+            join_threads();
+            workers_.clear();
+        }
+
+        task_manager_ = quickpool::sched::TaskManager{
+            threads, task_manager_.get_idle_policy()
+        };
+        workers_ = std::vector<std::thread>{ threads };
+        for (size_t id = 0; id < threads; ++id) {
+            add_worker(id);
+        }
+#if (defined __linux__)
+        if (threads > 0) {
+            set_thread_affinity();
+        }
+#endif
+        active_threads_ = threads;
+    }
+
+    //! @brief retrieves the number of active worker threads in the thread pool.
+    size_t get_active_threads() const { return active_threads_; }
+
+    //! @brief sets how workers wait for new tasks once they run out of work.
+    //! @param policy `IdlePolicy::block` parks them right away (the default),
+    //! `IdlePolicy::spin` spins for a few microseconds before parking, and
+    //! `IdlePolicy::poll` spins until new work arrives. Spinning cuts the
+    //! latency until a new task starts, but keeps the cores busy.
+    void set_idle_policy(IdlePolicy policy)
+    {
+        task_manager_.set_idle_policy(policy);
+    }
+
+    //! @brief retrieves how workers wait for new tasks.
+    IdlePolicy get_idle_policy() const
+    {
+        return task_manager_.get_idle_policy();
+    }
+
+    //! @brief pushes a job to the thread pool.
+    //! @param f a function.
+    //! @param args (optional) arguments passed to `f`.
+    template<class Function, class... Args>
+    void push(Function&& f, Args&&... args)
+    {
+        if (active_threads_ == 0) {
+            std::forward<Function>(f)(std::forward<Args>(args)...);
+            return;
+        }
+        task_manager_.push(detail::Task<Function, Args...>::make(
+          std::forward<Function>(f), std::forward<Args>(args)...));
+    }
+
+    //! @brief pushes `n` jobs running `f(0)`, ..., `f(n - 1)` to the thread
+    //! pool.
+    //!
+    //! Much cheaper than `n` calls to `push()`: the jobs are split into one
+    //! batch per worker queue, and every queue is locked and woken up only
+    //! once.
+    //! @param n number of jobs.
+    //! @param f a function taking a `size_t` argument; copied for each job.
+    template<class Function>
+    void push_n(size_t n, Function&& f)
+    {
+        if (active_threads_ == 0) {
+            for (size_t i = 0; i < n; ++i) {
+                f(i);
+            }
+            return;
+        }
+        task_manager_.push_n(
+          n, [&f](size_t i) { return [f, i]() mutable { f(i); }; });
+    }
+
+    //! @brief pushes jobs running `(*it)()` for all `first <= it < last` to
+    //! the thread pool; batched like `push_n()`.
+    //! @param first,last a range of functions without arguments, which are
+    //! copied; must be forward iterators, since the range is traversed twice.
+    template<class Iterator>
+    void push_bulk(Iterator first, Iterator last)
+    {
+        static_assert(
+          std::is_base_of<
+            std::forward_iterator_tag,
+            typename std::iterator_traits<Iterator>::iterator_category>::value,
+          "push_bulk() requires forward iterators");
+        if (active_threads_ == 0) {
+            for (; first != last; ++first) {
+                (*first)();
+            }
+            return;
+        }
+        const auto n = static_cast<size_t>(std::distance(first, last));
+        task_manager_.push_n(n, [&first](size_t) { return *first++; });
+    }
+
+    //! @brief executes a job asynchronously on the global thread pool.
+    //! @param f a function.
+    //! @param args (optional) arguments passed to `f`.
+    //! @return A `std::future` for the task. Call `future.get()` to
+    //! retrieve the results at a later point in time (blocking).
+    template<class Function, class... Args>
+    auto async(Function&& f, Args&&... args)
+      -> std::future<typename detail::Task<Function, Args...>::type>
+    {
+        auto pack = detail::Task<Function, Args...>::make(
+          std::forward<Function>(f), std::forward<Args>(args)...);
+        using result_t = typename detail::Task<Function, Args...>::type;
+        using pack_t = std::packaged_task<result_t()>;
+        auto task_ptr = std::make_shared<pack_t>(std::move(pack));
+        this->push([task_ptr] { (*task_ptr)(); });
+        return task_ptr->get_future();
+    }
+
+    //! @brief executes a job asynchronously on the thread pool.
+    //!
+    //! Unlike `async()`, the task and its result share a single allocation,
+    //! and the returned `Future` can be continued with `then()`,
+    //! `when_all()`, and `when_any()` without blocking.
+    //! @param f a function.
+    //! @param args (optional) arguments passed to `f`.
+    //! @return A `Future` for the result of `f(args...)`.
+    template<class Function, class... Args>
+    auto submit(Function&& f, Args&&... args)
+      -> Future<typename detail::Task<Function, Args...>::type>
+    {
+        using result_t = typename detail::Task<Function, Args...>::type;
+        auto task = detail::Task<Function, Args...>::make(
+          std::forward<Function>(f), std::forward<Args>(args)...);
+        auto state = new sched::TaskState<result_t, decltype(task)>(
+          this, std::move(task));
+        Future<result_t> future(state);
+        state->retain();
+        sched::schedule(*this, state);
+        return future;
+    }
+
+#if QUICKPOOL_HAS_COROUTINES
+    //! @brief returns an awaitable that moves the awaiting coroutine to the
+    //! pool: `co_await pool.schedule();` suspends the coroutine and resumes
+    //! it on a worker thread.
+    auto schedule() noexcept { return Scheduler{ this }; }
+#endif
+
+    //! @brief runs functions in parallel and waits for all of them.
+    //!
+    //! The calling thread runs `f` and spawns the others (see `ForkJoin`).
+    //! While waiting, it runs queued tasks, so calls can be nested, e.g., in
+    //! recursive divide-and-conquer algorithms.
+    //! @param f,fs functions without arguments.
+    //! @throws the first exception thrown by one of the functions.
+    template<class Function, class... Functions>
+    void parallel_invoke(Function&& f, Functions&&... fs)
+    {
+        ForkJoin scope(*this);
+        using expand = int[];
+        (void)expand{ 0, (scope.spawn(std::forward<Functions>(fs)), 0)... };
+        std::forward<Function>(f)();
+        scope.sync();
+    }
+
+    //! @brief computes an index-based parallel for loop.
+    //!
+    //! Waits until the loop has finished. The waiting thread works on the
+    //! loop and runs other queued tasks in the meantime, so parallel loops
+    //! can be nested from any thread.
+    //!
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param f a function taking an index argument (the 'loop body').
+    //! Indices have the common type of `begin` and `end`, which can be any
+    //! integer type.
+    template<class Begin,
+             class End,
+             class UnaryFunction,
+             class Index = loop::index_t<Begin, End>>
+    void parallel_for(Begin begin, End end, UnaryFunction f)
+    {
+        this->parallel_for(begin, end, std::move(f), 1);
+    }
+
+    //! @brief computes an index-based parallel for loop in chunks.
+    //!
+    //! Same as `parallel_for(begin, end, f)`, but workers claim
+    //! `grain_size` indices at once. This reduces scheduling overhead for
+    //! tiny loop bodies.
+    //!
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param f a function taking an index argument (the 'loop body').
+    //! @param grain_size number of indices processed per chunk; 0 selects
+    //! the chunk size automatically.
+    template<class Begin,
+             class End,
+             class UnaryFunction,
+             class Index = loop::index_t<Begin, End>>
+    void parallel_for(Begin begin,
+                      End end,
+                      UnaryFunction f,
+                      size_t grain_size)
+    {
+        this->parallel_for_range(
+          static_cast<Index>(begin),
+          static_cast<Index>(end),
+          [f](Index chunk_begin, Index chunk_end) mutable {
+              for (auto i = chunk_begin; i < chunk_end; ++i) {
+                  f(i);
+              }
+          },
+          grain_size);
+    }
+
+    //! @brief computes a chunked parallel for loop with a range body.
+    //!
+    //! The loop body is called as `f(chunk_begin, chunk_end)` for disjoint
+    //! chunks covering `[begin, end)`, so it can run a tight inner loop.
+    //! Waits until the loop has finished.
+    //!
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param f a function taking two index arguments `chunk_begin` and
+    //! `chunk_end`.
+    //! @param grain_size maximal number of indices per chunk; 0 (default)
+    //! selects the chunk size automatically.
+    template<class Begin,
+             class End,
+             class RangeFunction,
+             class Index = loop::index_t<Begin, End>>
+    void parallel_for_range(Begin begin,
+                            End end,
+                            RangeFunction f,
+                            size_t grain_size = 0)
+    {
+        this->run_loop(static_cast<Index>(begin),
+                       static_cast<Index>(end),
+                       grain_size,
+                       [f](size_t, Index chunk_begin, Index chunk_end) mutable {
+                           f(chunk_begin, chunk_end);
+                       });
+    }
+
+    //! @brief computes a parallel for loop that replays the thread
+    //! assignment of earlier loops.
+    //!
+    //! Same as `parallel_for(begin, end, f)`, but each subrange is sent to
+    //! the worker that processed it in the last loop run with the same
+    //! partitioner. Useful for loops repeatedly touching the same data.
+    //!
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param f a function taking an index argument (the 'loop body').
+    //! @param partitioner records and replays the thread assignment.
+    template<class Begin,
+             class End,
+             class UnaryFunction,
+             class Index = loop::index_t<Begin, End>>
+    void parallel_for(Begin begin,
+                      End end,
+                      UnaryFunction f,
+                      AffinityPartitioner& partitioner)
+    {
+        this->parallel_for_range(
+          static_cast<Index>(begin),
+          static_cast<Index>(end),
+          [f](Index chunk_begin, Index chunk_end) mutable {
+              for (auto i = chunk_begin; i < chunk_end; ++i) {
+                  f(i);
+              }
+          },
+          partitioner);
+    }
+
+    //! @brief computes a chunked parallel for loop with a range body that
+    //! replays the thread assignment of earlier loops.
+    //!
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param f a function taking two index arguments `chunk_begin` and
+    //! `chunk_end`.
+    //! @param partitioner records and replays the thread assignment.
+    template<class Begin,
+             class End,
+             class RangeFunction,
+             class Index = loop::index_t<Begin, End>>
+    void parallel_for_range(Begin begin,
+                            End end,
+                            RangeFunction f,
+                            AffinityPartitioner& partitioner)
+    {
+        this->run_loop(static_cast<Index>(begin),
+                       static_cast<Index>(end),
+                       partitioner.grain_size(),
+                       [f](size_t, Index chunk_begin, Index chunk_end) mutable {
+                           f(chunk_begin, chunk_end);
+                       },
+                       &partitioner);
+    }
+
+    //! @brief computes a parallel for loop that adapts to the cost of its
+    //! body.
+    //!
+    //! Same as `parallel_for(begin, end, f)`, but the loop may run partly or
+    //! entirely on the calling thread if it's too small to pay for waking
+    //! other threads (see `AdaptivePartitioner`).
+    //!
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param f a function taking an index argument (the 'loop body').
+    //! @param partitioner learns the cost of `f`.
+    template<class Begin,
+             class End,
+             class UnaryFunction,
+             class Index = loop::index_t<Begin, End>>
+    void parallel_for(Begin begin,
+                      End end,
+                      UnaryFunction f,
+                      AdaptivePartitioner& partitioner)
+    {
+        this->parallel_for_range(
+          static_cast<Index>(begin),
+          static_cast<Index>(end),
+          [f](Index chunk_begin, Index chunk_end) mutable {
+              for (auto i = chunk_begin; i < chunk_end; ++i) {
+                  f(i);
+              }
+          },
+          partitioner);
+    }
+
+    //! @brief computes a chunked parallel for loop with a range body that
+    //! adapts to the cost of its body.
+    //!
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param f a function taking two index arguments `chunk_begin` and
+    //! `chunk_end`.
+    //! @param partitioner learns the cost of `f`.
+    template<class Begin,
+             class End,
+             class RangeFunction,
+             class Index = loop::index_t<Begin, End>>
+    void parallel_for_range(Begin begin,
+                            End end,
+                            RangeFunction f,
+                            AdaptivePartitioner& partitioner)
+    {
+        this->run_loop(static_cast<Index>(begin),
+                       static_cast<Index>(end),
+                       partitioner.grain_size(),
+                       [f](size_t, Index chunk_begin, Index chunk_end) mutable {
+                           f(chunk_begin, chunk_end);
+                       },
+                       nullptr,
+                       &partitioner.cost_);
+    }
+
+    //! @brief computes a tiled parallel for loop over a 2D index space.
+    //!
+    //! The space `[0, rows) x [0, cols)` is split into square tiles, which
+    //! are ordered along a Morton curve. Loop workers own and steal whole
+    //! tiles, so a tile is never split between threads and neighboring tiles
+    //! tend to run on the same thread. Waits until the loop has finished.
+    //!
+    //! @param rows number of rows.
+    //! @param cols number of columns.
+    //! @param tile edge length of the tiles; should be chosen such that the
+    //! data touched by a tile fits into cache.
+    //! @param f a function called as `f(row_begin, row_end, col_begin,
+    //! col_end)` for each tile.
+    template<class TileFunction>
+    void parallel_for_2d(size_t rows, size_t cols, size_t tile, TileFunction f)
+    {
+        // run_loop() joins before returning, so the tiles can live here.
+        const loop::Tiles<2> tiles({ { rows, cols } }, tile);
+        this->run_loop(static_cast<size_t>(0),
+                       tiles.count(),
+                       1,
+                       [&tiles, f](size_t, size_t b, size_t e) mutable {
+                           std::array<size_t, 2> pos;
+                           for (auto t = b; t < e; ++t) {
+                               if (tiles.locate(t, pos)) {
+                                   f(tiles.begin(pos, 0),
+                                     tiles.end(pos, 0),
+                                     tiles.begin(pos, 1),
+                                     tiles.end(pos, 1));
+                               }
+                           }
+                       });
+    }
+
+    //! @brief computes a tiled parallel for loop over a 3D index space.
+    //!
+    //! Same as `parallel_for_2d()`, but for the space `[0, n0) x [0, n1) x
+    //! [0, n2)` split into cubic tiles.
+    //!
+    //! @param n0,n1,n2 extents of the three dimensions.
+    //! @param tile edge length of the tiles.
+    //! @param f a function called as `f(b0, e0, b1, e1, b2, e2)` for each
+    //! tile `[b0, e0) x [b1, e1) x [b2, e2)`.
+    template<class TileFunction>
+    void parallel_for_3d(size_t n0,
+                         size_t n1,
+                         size_t n2,
+                         size_t tile,
+                         TileFunction f)
+    {
+        const loop::Tiles<3> tiles({ { n0, n1, n2 } }, tile);
+        this->run_loop(static_cast<size_t>(0),
+                       tiles.count(),
+                       1,
+                       [&tiles, f](size_t, size_t b, size_t e) mutable {
+                           std::array<size_t, 3> pos;
+                           for (auto t = b; t < e; ++t) {
+                               if (tiles.locate(t, pos)) {
+                                   f(tiles.begin(pos, 0),
+                                     tiles.end(pos, 0),
+                                     tiles.begin(pos, 1),
+                                     tiles.end(pos, 1),
+                                     tiles.begin(pos, 2),
+                                     tiles.end(pos, 2));
+                               }
+                           }
+                       });
+    }
+
+    //! @brief computes a parallel reduction over an index range.
+    //!
+    //! Each loop worker accumulates a private, cache-line-aligned partial
+    //! result; the partials are merged in a final tree combine.
+    //!
+    //! @param begin first index of the loop.
+    //! @param end the loop runs in the range `[begin, end)`.
+    //! @param identity identity element of `combine`; initial value of all
+    //! partial results.
+    //! @param map a function computing the contribution `map(i)` of index
+    //! `i`.
+    //! @param combine a function merging two partial results; must be
+    //! associative and commutative.
+    //! @param grain_size number of indices processed per chunk; 0 (default)
+    //! selects the chunk size automatically.
+    //! @return the reduction `combine(identity, map(begin), ...)`.
+    template<class Begin,
+             class End,
+             class T,
+             class MapFunction,
+             class CombineFunction,
+             class Index = loop::index_t<Begin, End>>
+    T parallel_reduce(Begin begin,
+                      End end,
+                      T identity,
+                      MapFunction map,
+                      CombineFunction combine,
+                      size_t grain_size = 0)
+    {
+        const auto first = static_cast<Index>(begin);
+        const auto last = static_cast<Index>(end);
+        if (last <= first) {
+            return identity;
+        }
+
+        using Partial = mem::aligned::padded<T>;
+        const auto num_partials = active_threads_.load(mem::relaxed) + 1;
+        auto partials = std::make_shared<mem::aligned::vector<Partial>>(
+          num_partials, Partial{ identity });
+        this->run_loop(
+          first, last, grain_size, [=](size_t k, Index b, Index e) mutable {
+              auto& partial = (*partials)[k].value;
+              for (auto i = b; i < e; ++i) {
+                  partial = combine(std::move(partial), map(i));
+              }
+          });
+
+        // tree combine
+        auto& p = *partials;
+        for (size_t stride = 1; stride < p.size(); stride *= 2) {
+            for (size_t i = 0; i + stride < p.size(); i += 2 * stride) {
+                auto& other = p[i + stride].value;
+                p[i].value = combine(std::move(p[i].value), std::move(other));
+            }
+        }
+        return std::move(p[0].value);
+    }
+
+    //! @brief computes an iterator-based parallel for loop.
+    //!
+    //! Waits until the loop has finished, so parallel loops can be nested.
+    //!
+    //! @param items an object allowing for `std::begin()` and `std::end()`.
+    //! @param f function to be applied as `f(*it)` for the iterator in the
+    //! range `[begin, end)` (the 'loop body').
+    template<class Items, class UnaryFunction>
+    inline void parallel_for_each(Items& items, UnaryFunction f)
+    {
+        auto begin = std::begin(items);
+        auto end = std::end(items);
+        if (begin == end) {
+            return;
+        }
+        typedef typename std::iterator_traits<decltype(begin)>::iterator_category
+          iterator_category;
+        this->parallel_for_each_impl(begin, end, f, iterator_category{});
+    }
+
+    //! @brief computes an inclusive prefix scan in parallel.
+    //!
+    //! Writes `x[0]`, `op(x[0], x[1])`, ... to `d_first`. Works in two
+    //! passes over one contiguous block per active thread: the first pass
+    //! reduces each block, the second scans each block starting from the
+    //! combined results of all previous blocks.
+    //!
+    //! @param first,last random access iterators to the input range.
+    //! @param d_first random access iterator to the output range; may be
+    //! equal to `first`.
+    //! @param op an associative binary operation.
+    //! @return iterator to the element past the last element written.
+    template<class InputIt, class OutputIt, class BinaryOperation>
+    OutputIt parallel_inclusive_scan(InputIt first,
+                                     InputIt last,
+                                     OutputIt d_first,
+                                     BinaryOperation op)
+    {
+        using T = typename std::iterator_traits<InputIt>::value_type;
+        const auto size = static_cast<size_t>(std::distance(first, last));
+        const loop::Blocks blocks{ size, this->num_blocks(size) };
+        if (blocks.count <= 1) {
+            return std::partial_sum(first, last, d_first, op);
+        }
+
+        auto carries = this->scan_block_sums<T>(first, blocks, op);
+        this->parallel_for(static_cast<size_t>(0), blocks.count, [&](size_t b) {
+            auto it = first + static_cast<std::ptrdiff_t>(blocks.begin(b));
+            auto end = first + static_cast<std::ptrdiff_t>(blocks.end(b));
+            auto out = d_first + static_cast<std::ptrdiff_t>(blocks.begin(b));
+            if (b == 0) {
+                std::partial_sum(it, end, out, op);
+                return;
+            }
+            T acc = carries[b - 1];
+            for (; it != end; ++it, ++out) {
+                acc = op(acc, *it);
+                *out = acc;
+            }
+        });
+        return d_first + static_cast<std::ptrdiff_t>(size);
+    }
+
+    //! @brief computes an inclusive prefix sum in parallel.
+    //! @param first,last random access iterators to the input range.
+    //! @param d_first random access iterator to the output range; may be
+    //! equal to `first`.
+    //! @return iterator to the element past the last element written.
+    template<class InputIt, class OutputIt>
+    OutputIt parallel_inclusive_scan(InputIt first,
+                                     InputIt last,
+                                     OutputIt d_first)
+    {
+        using T = typename std::iterator_traits<InputIt>::value_type;
+        return this->parallel_inclusive_scan(
+          first, last, d_first, std::plus<T>());
+    }
+
+    //! @brief computes an exclusive prefix scan in parallel.
+    //!
+    //! Writes `init`, `op(init, x[0])`, `op(op(init, x[0]), x[1])`, ... to
+    //! `d_first`. Works in two passes over one contiguous block per active
+    //! thread: the first pass reduces each block, the second scans each block
+    //! starting from the combined results of all previous blocks.
+    //!
+    //! @param first,last random access iterators to the input range.
+    //! @param d_first random access iterator to the output range; may be
+    //! equal to `first`.
+    //! @param init initial value.
+    //! @param op an associative binary operation.
+    //! @return iterator to the element past the last element written.
+    template<class InputIt, class OutputIt, class T, class BinaryOperation>
+    OutputIt parallel_exclusive_scan(InputIt first,
+                                     InputIt last,
+                                     OutputIt d_first,
+                                     T init,
+                                     BinaryOperation op)
+    {
+        const auto size = static_cast<size_t>(std::distance(first, last));
+        const loop::Blocks blocks{ size, this->num_blocks(size) };
+        auto scan_block = [&](size_t b, T acc) {
+            auto it = first + static_cast<std::ptrdiff_t>(blocks.begin(b));
+            auto end = first + static_cast<std::ptrdiff_t>(blocks.end(b));
+            auto out = d_first + static_cast<std::ptrdiff_t>(blocks.begin(b));
+            for (; it != end; ++it, ++out) {
+                T value = *it; // read before write for in-place scans
+                *out = acc;
+                acc = op(std::move(acc), value);
+            }
+        };
+        if (blocks.count <= 1) {
+            if (size > 0) {
+                scan_block(0, std::move(init));
+            }
+            return d_first + static_cast<std::ptrdiff_t>(size);
+        }
+
+        auto carries = this->scan_block_sums<T>(first, blocks, op);
+        this->parallel_for(static_cast<size_t>(0), blocks.count, [&](size_t b) {
+            scan_block(b, b == 0 ? init : op(init, carries[b - 1]));
+        });
+        return d_first + static_cast<std::ptrdiff_t>(size);
+    }
+
+    //! @brief computes an exclusive prefix sum in parallel.
+    //! @param first,last random access iterators to the input range.
+    //! @param d_first random access iterator to the output range; may be
+    //! equal to `first`.
+    //! @param init initial value.
+    //! @return iterator to the element past the last element written.
+    template<class InputIt, class OutputIt, class T>
+    OutputIt parallel_exclusive_scan(InputIt first,
+                                     InputIt last,
+                                     OutputIt d_first,
+                                     T init)
+    {
+        return this->parallel_exclusive_scan(
+          first, last, d_first, std::move(init), std::plus<T>());
+    }
+
+    //! @brief sorts a range in parallel.
+    //!
+    //! A parallel merge sort: one block per active thread is sorted with
+    //! `std::sort()`, then sorted runs are merged pairwise. Each merge is
+    //! split into pieces of similar size, so all threads stay busy until the
+    //! last merge. Small ranges are sorted serially. The sort is not stable.
+    //!
+    //! @param first,last random access iterators to the range.
+    //! @param comp comparison function object (strict weak ordering).
+    template<class RandomIt, class Compare>
+    void parallel_sort(RandomIt first, RandomIt last, Compare comp)
+    {
+        using T = typename std::iterator_traits<RandomIt>::value_type;
+        const auto size = static_cast<size_t>(std::distance(first, last));
+        const auto num_blocks =
+          std::min(this->num_blocks(size), size / detail::sort_cutoff);
+        if (num_blocks <= 1) {
+            std::sort(first, last, comp);
+            return;
+        }
+
+        // sort blocks
+        const loop::Blocks blocks{ size, num_blocks };
+        std::vector<size_t> bounds(num_blocks + 1);
+        for (size_t b = 0; b <= num_blocks; ++b) {
+            bounds[b] = blocks.begin(b);
+        }
+        this->parallel_for(static_cast<size_t>(0), num_blocks, [&](size_t b) {
+            std::sort(first + static_cast<std::ptrdiff_t>(bounds[b]),
+                      first + static_cast<std::ptrdiff_t>(bounds[b + 1]),
+                      comp);
+        });
+
+        // merge sorted runs, alternating between the range and a buffer
+        mem::aligned::buffer<T> buffer(size);
+        this->parallel_for_range(
+          static_cast<size_t>(0), size, [&](size_t b, size_t e) {
+              for (auto i = b; i < e; ++i) {
+                  ::new (static_cast<void*>(buffer.data + i))
+                    T(std::move(first[static_cast<std::ptrdiff_t>(i)]));
+              }
+          });
+        buffer.constructed = true;
+        bool in_buffer = true;
+        while (bounds.size() > 2) {
+            if (in_buffer) {
+                this->merge_runs(buffer.data, first, bounds, comp);
+            } else {
+                this->merge_runs(first, buffer.data, bounds, comp);
+            }
+            in_buffer = !in_buffer;
+        }
+        if (in_buffer) {
+            this->move_from_buffer(buffer, first);
+        }
+    }
+
+    //! @brief sorts a range in ascending order in parallel.
+    //! @param first,last random access iterators to the range.
+    template<class RandomIt>
+    void parallel_sort(RandomIt first, RandomIt last)
+    {
+        using T = typename std::iterator_traits<RandomIt>::value_type;
+        this->parallel_sort(first, last, std::less<T>());
+    }
+
+    //! @brief copies the elements satisfying a predicate in parallel.
+    //!
+    //! Runs in two passes: each block counts its matches, then all blocks
+    //! copy their matches to offsets given by a scan over the counts. The
+    //! relative order of elements is preserved and `pred` is called exactly
+    //! once per element.
+    //!
+    //! @param first,last random access iterators to the input range.
+    //! @param d_first random access iterator to the beginning of the output
+    //!   range; must not overlap with the input.
+    //! @param pred unary predicate.
+    //! @return iterator to the element past the last element copied.
+    template<class InputIt, class OutputIt, class UnaryPredicate>
+    OutputIt parallel_copy_if(InputIt first,
+                              InputIt last,
+                              OutputIt d_first,
+                              UnaryPredicate pred)
+    {
+        const auto size = static_cast<size_t>(std::distance(first, last));
+        const loop::Blocks blocks{ size, this->num_blocks(size) };
+        if (blocks.count <= 1) {
+            return std::copy_if(first, last, d_first, pred);
+        }
+
+        std::vector<unsigned char> flags(size);
+        const auto offsets = this->count_if_blocks(first, blocks, flags, pred);
+        this->parallel_for(static_cast<size_t>(0), blocks.count, [&](size_t b) {
+            auto out = d_first + static_cast<std::ptrdiff_t>(offsets[b]);
+            for (auto i = blocks.begin(b); i < blocks.end(b); ++i) {
+                if (flags[i]) {
+                    *out++ = first[static_cast<std::ptrdiff_t>(i)];
+                }
+            }
+        });
+        return d_first + static_cast<std::ptrdiff_t>(offsets.back());
+    }
+
+    //! @brief removes the elements satisfying a predicate in parallel.
+    //!
+    //! Kept elements are moved to the front of the range in their original
+    //! order; the elements after the returned iterator are valid but
+    //! unspecified. Uses a temporary buffer for the kept elements.
+    //!
+    //! @param first,last random access iterators to the range.
+    //! @param pred unary predicate returning `true` for elements to remove.
+    //! @return iterator to the new end of the range.
+    template<class RandomIt, class UnaryPredicate>
+    RandomIt parallel_remove_if(RandomIt first,
+                                RandomIt last,
+                                UnaryPredicate pred)
+    {
+        using T = typename std::iterator_traits<RandomIt>::value_type;
+        const auto size = static_cast<size_t>(std::distance(first, last));
+        const loop::Blocks blocks{ size, this->num_blocks(size) };
+        if (blocks.count <= 1) {
+            return std::remove_if(first, last, pred);
+        }
+
+        std::vector<unsigned char> flags(size);
+        const auto offsets = this->count_if_blocks(
+          first, blocks, flags, [&](const T& x) { return !pred(x); });
+        mem::aligned::buffer<T> buffer(offsets.back());
+        this->parallel_for(static_cast<size_t>(0), blocks.count, [&](size_t b) {
+            auto out = buffer.data + offsets[b];
+            for (auto i = blocks.begin(b); i < blocks.end(b); ++i) {
+                if (flags[i]) {
+                    ::new (static_cast<void*>(out++))
+                      T(std::move(first[static_cast<std::ptrdiff_t>(i)]));
+                }
+            }
+        });
+        buffer.constructed = true;
+        this->move_from_buffer(buffer, first);
+        return first + static_cast<std::ptrdiff_t>(offsets.back());
+    }
+
+    //! @brief partitions a range in parallel.
+    //!
+    //! Moves all elements satisfying `pred` before all other elements. Unlike
+    //! `std::partition()`, the relative order within both groups is
+    //! preserved. Uses a temporary buffer of the same size as the range.
+    //!
+    //! @param first,last random access iterators to the range.
+    //! @param pred unary predicate.
+    //! @return iterator to the first element of the second group.
+    template<class RandomIt, class UnaryPredicate>
+    RandomIt parallel_partition(RandomIt first,
+                                RandomIt last,
+                                UnaryPredicate pred)
+    {
+        using T = typename std::iterator_traits<RandomIt>::value_type;
+        const auto size = static_cast<size_t>(std::distance(first, last));
+        const loop::Blocks blocks{ size, this->num_blocks(size) };
+        if (blocks.count <= 1) {
+            return std::stable_partition(first, last, pred);
+        }
+
+        std::vector<unsigned char> flags(size);
+        const auto offsets = this->count_if_blocks(first, blocks, flags, pred);
+        const auto num_true = offsets.back();
+        mem::aligned::buffer<T> buffer(size);
+        this->parallel_for(static_cast<size_t>(0), blocks.count, [&](size_t b) {
+            auto out_true = buffer.data + offsets[b];
+            auto out_false =
+              buffer.data + num_true + (blocks.begin(b) - offsets[b]);
+            for (auto i = blocks.begin(b); i < blocks.end(b); ++i) {
+                auto out = flags[i] ? out_true++ : out_false++;
+                ::new (static_cast<void*>(out))
+                  T(std::move(first[static_cast<std::ptrdiff_t>(i)]));
+            }
+        });
+        buffer.constructed = true;
+        this->move_from_buffer(buffer, first);
+        return first + static_cast<std::ptrdiff_t>(num_true);
+    }
+
+    //! @brief finds the first element satisfying a predicate in parallel.
+    //!
+    //! Once a match is found, chunks after it are cancelled and workers stop
+    //! calling `pred` there. Chunks before it are still searched, so the
+    //! result is the same as for `std::find_if()`.
+    //!
+    //! @param first,last random access iterators to the range.
+    //! @param pred unary predicate.
+    //! @return iterator to the first element satisfying `pred`, or `last` if
+    //! there is none.
+    template<class RandomIt, class UnaryPredicate>
+    RandomIt parallel_find_if(RandomIt first,
+                              RandomIt last,
+                              UnaryPredicate pred)
+    {
+        const auto size = static_cast<size_t>(std::distance(first, last));
+        std::atomic<size_t> found{ size };
+        this->run_loop(
+          static_cast<size_t>(0),
+          size,
+          0,
+          [&](size_t, size_t begin, size_t end) {
+              for (auto i = begin; i < end; ++i) {
+                  auto current = found.load(mem::relaxed);
+                  if (i >= current) {
+                      return true; // an earlier match decides the result
+                  }
+                  if (pred(first[static_cast<std::ptrdiff_t>(i)])) {
+                      while (i < current && !found.compare_exchange_weak(
+                                              current, i, mem::relaxed)) {
+                      }
+                      return true;
+                  }
+              }
+              return false;
+          });
+        return first + static_cast<std::ptrdiff_t>(found.load());
+    }
+
+    //! @brief checks in parallel whether an element satisfies a predicate.
+    //!
+    //! Once a match is found, all remaining chunks are cancelled.
+    //!
+    //! @param first,last random access iterators to the range.
+    //! @param pred unary predicate.
+    //! @return `true` if `pred` returns `true` for some element.
+    template<class RandomIt, class UnaryPredicate>
+    bool parallel_any_of(RandomIt first, RandomIt last, UnaryPredicate pred)
+    {
+        const auto size = static_cast<size_t>(std::distance(first, last));
+        std::atomic_bool found{ false };
+        this->run_loop<loop::Cancel::all>(
+          static_cast<size_t>(0),
+          size,
+          0,
+          [&](size_t, size_t begin, size_t end) {
+              for (auto i = begin; i < end; ++i) {
+                  if (found.load(mem::relaxed)) {
+                      return true;
+                  }
+                  if (pred(first[static_cast<std::ptrdiff_t>(i)])) {
+                      found.store(true, mem::relaxed);
+                      return true;
+                  }
+              }
+              return false;
+          });
+        return found.load();
+    }
+
+    //! @brief checks in parallel whether all elements satisfy a predicate.
+    //!
+    //! Once an element fails `pred`, all remaining chunks are cancelled.
+    //!
+    //! @param first,last random access iterators to the range.
+    //! @param pred unary predicate.
+    //! @return `true` if `pred` returns `true` for all elements (or the range
+    //! is empty).
+    template<class RandomIt, class UnaryPredicate>
+    bool parallel_all_of(RandomIt first, RandomIt last, UnaryPredicate pred)
+    {
+        using T = typename std::iterator_traits<RandomIt>::reference;
+        return !this->parallel_any_of(
+          first, last, [&](T x) { return !pred(x); });
+    }
+
+    //! @brief waits for all jobs currently running on the thread
+    //! pool. Has no effect when called from threads other than the one that
+    //! created the pool.
+    //! @param millis if > 0: stops waiting after millis ms.
+    void wait(size_t millis = 0) { task_manager_.wait_for_finish(millis); }
+
+    //! @brief Stops the pool, waits for all tasks to finish, resets to neutral 
+    // state, and rethrows an exception if one is pending.
+    void stop_and_reset()  
+    { 
+        task_manager_.report_fail(std::current_exception());
+        task_manager_.wait_for_finish();
+        task_manager_.rethrow_exception();
+    }
+
+    //! @brief checks whether all jobs are done.
+    bool done() const { return task_manager_.done(); }
+
+    //! @brief allocator respecting memory alignment.
+    static void* operator new(size_t count)
+    {
+        return mem::aligned::alloc(alignof(ThreadPool), count);
+    }
+
+    //! @brief deallocator respecting memory alignment.
+    static void operator delete(void* ptr) { mem::aligned::free(ptr); }
+
+  private:
+    friend class ForkJoin;
+    friend class TaskGroup;
+    friend class TaskGraph;
+    template<class T>
+    friend class Future;
+    friend void sched::schedule(ThreadPool& pool, sched::FutureNode* node);
+#if QUICKPOOL_HAS_COROUTINES
+    friend void sched::resume(ThreadPool& pool,
+                              std::coroutine_handle<> handle);
+    friend void sched::wait_for(sched::Latch& latch);
+
+    struct Scheduler
+    {
+        bool await_ready() const noexcept
+        {
+            return pool->active_threads_ == 0;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            sched::resume(*pool, handle);
+        }
+
+        void await_resume() const noexcept {}
+
+        ThreadPool* pool;
+    };
+#endif
+
+    //! pushes a task to the deque of the calling worker; other threads push
+    //! round robin. The task is tracked by its caller, so it runs even if
+    //! another task has failed (see `TaskManager::push_tracked()`).
+    template<typename Task>
+    void push_local(Task&& task)
+    {
+        task_manager_.push_tracked(std::forward<Task>(task));
+    }
+
+    //! runs a chunked loop on the worker threads and the calling thread;
+    //! returns when the loop has finished.
+    //! @tparam cancel chunks skipped when the loop body returns `true`.
+    //! @param first first index of the loop.
+    //! @param last the loop runs in the range `[first, last)`.
+    //! @param grain_size requested chunk size; 0 selects one automatically.
+    //! @param f loop body called as `f(k, chunk_begin, chunk_end)`, where
+    //! `k <= get_active_threads()` identifies the loop worker. If it returns
+    //! `true`, the chunks selected by `cancel` are skipped.
+    //! @param partitioner optional; replays and records which pool worker
+    //! runs which loop worker.
+    //! @param cost optional; learned cost of `f`, which decides how many
+    //! threads join (see `AdaptivePartitioner`). Otherwise, all active
+    //! threads join.
+    template<loop::Cancel cancel = loop::Cancel::later,
+             class Index,
+             class LoopFunction>
+    void run_loop(Index first,
+                  Index last,
+                  size_t grain_size,
+                  LoopFunction f,
+                  AffinityPartitioner* partitioner = nullptr,
+                  loop::Cost* cost = nullptr)
+    {
+        if (last <= first) {
+            return;
+        }
+        const auto active_threads = active_threads_.load(mem::relaxed);
+        if (active_threads == 0) {
+            f(0, first, last);
+            return;
+        }
+
+        // Adaptive loops only wake as many workers as the cost of the body
+        // is worth. This thread starts alone and measures a sample, so the
+        // learned cost stays fresh; cheap loops never leave it.
+        auto num_workers = active_threads;
+        if (cost) {
+            num_workers = loop::run_serial_prefix(
+              first, last, f, *cost, active_threads, grain_size);
+            if (num_workers == 0) {
+                return;
+            }
+        }
+
+        // Worker states count chunks. 32-bit counts fit into a single 8-byte
+        // compare-and-swap. Wider counts need 16-byte compare-and-swap; if
+        // that's not lock free, use larger chunks instead.
+        loop::Chunks<Index> chunks{ first, last, num_workers, grain_size };
+        const auto max_packed = std::numeric_limits<std::uint32_t>::max();
+        if (!loop::wide_state_is_lock_free()) {
+            chunks.limit_count(static_cast<typename loop::Chunks<Index>::Size>(
+              std::min<std::uint64_t>(max_packed, chunks.count)));
+        }
+        if (chunks.count <= max_packed) {
+            this->run_chunks<std::uint32_t, cancel>(
+              chunks, num_workers, std::move(f), partitioner);
+        } else {
+            using Wide = typename std::conditional<(sizeof(Index) > 4) &&
+                                                     QUICKPOOL_HAS_WIDE_CAS,
+                                                   std::uint64_t,
+                                                   std::uint32_t>::type;
+            this->run_chunks<Wide, cancel>(
+              chunks, num_workers, std::move(f), partitioner);
+        }
+    }
+
+    //! @tparam T unsigned integer type for counting chunks.
+    //! @tparam cancel chunks skipped when the loop body returns `true`.
+    //! @param chunks chunks of the loop range.
+    //! @param num_workers maximal number of loop workers.
+    //! @param f loop body, see `run_loop()`.
+    //! @param partitioner optional; replays and records which pool worker
+    //! runs which loop worker.
+    template<typename T,
+             loop::Cancel cancel,
+             class Index,
+             class LoopFunction>
+    void run_chunks(const loop::Chunks<Index>& chunks,
+                    size_t num_workers,
+                    LoopFunction f,
+                    AffinityPartitioner* partitioner)
+    {
+        using Size = typename loop::Chunks<Index>::Size;
+
+        // each worker has its dedicated range, but can steal part of
+        // another worker's ranges when done with own; the last worker
+        // starts empty and belongs to the calling thread.
+        const auto n = static_cast<size_t>(
+          std::min<std::uint64_t>(num_workers, chunks.count));
+        auto frame = this->loop_frames(T{}).acquire(n + 1);
+        frame->workers.reserve(n + 1);
+        frame->workers.reset(0, static_cast<T>(chunks.count), n);
+        frame->workers.emplace_back(static_cast<T>(0), static_cast<T>(0));
+        frame->latch.reset(chunks.count);
+
+        // All jobs share the body on this stack.
+        struct Body
+        {
+            const loop::Chunks<Index>& chunks;
+            LoopFunction& f;
+        } body{ chunks, f };
+        frame->body = &body;
+        frame->call = [](sched::LoopFrame<T>& frame, size_t k, T c) {
+            auto& body = *static_cast<Body*>(frame.body);
+            if (loop::call_body(body.f,
+                                k,
+                                body.chunks.begin(static_cast<Size>(c)),
+                                body.chunks.end(static_cast<Size>(c)))) {
+                frame.workers.cancel_from(
+                  cancel == loop::Cancel::all ? 0 : static_cast<T>(c + 1));
+            }
+        };
+
+        // Without affinity, the loop is published to all workers at once if
+        // no other loop is published. Otherwise, one job per worker is
+        // pushed; jobs without affinity fit into the small buffer of
+        // `std::function`, so pushing them doesn't allocate.
+        std::shared_ptr<AffinityPartitioner::Loop> loop;
+        if (partitioner) {
+            loop = partitioner->start(this, n, num_workers);
+        }
+        const bool published = !loop && task_manager_.publish(*frame, n);
+        size_t pushed = published ? n : 0;
+        std::exception_ptr push_error{ nullptr };
+        try {
+            for (; pushed < n; pushed++) {
+                const auto k = pushed;
+                if (!loop) {
+                    task_manager_.push_tracked([frame, k] {
+                        frame->run_worker(k);
+                        frame->release();
+                    });
+                    continue;
+                }
+                auto job = [this, frame, loop] {
+                    // Workers of other pools may help with the job; they
+                    // have no affinity to this pool's queues.
+                    const auto id = task_manager_.own_worker();
+                    const auto worker = loop->claim(id);
+                    loop->record(worker, id);
+                    frame->run_worker(worker);
+                    frame->release();
+                };
+                if (loop->workers[k] < num_workers) {
+                    task_manager_.push_tracked(std::move(job),
+                                               loop->workers[k]);
+                } else {
+                    task_manager_.push_tracked(std::move(job));
+                }
+            }
+        } catch (...) {
+            // The remaining workers' ranges are stolen by this thread, but
+            // the body must not be left behind for jobs already pushed.
+            push_error = std::current_exception();
+            for (; pushed < n; pushed++) {
+                frame->release();
+            }
+        }
+
+        frame->run_worker(n);
+        this->wait_for(frame->latch);
+        if (published) {
+            // release the references of workers that never joined
+            for (auto k = task_manager_.retract(*frame); k > 0; k--) {
+                frame->release();
+            }
+        }
+        if (loop) {
+            partitioner->finish(*loop);
+        }
+        auto loop_error = frame->latch.error();
+        frame->release();
+        if (push_error) {
+            std::rethrow_exception(push_error);
+        }
+        if (loop_error) {
+            std::rethrow_exception(loop_error);
+        }
+    }
+
+    //! recycled frames for loops counting chunks with type `T`.
+    sched::LoopFrames<std::uint32_t>& loop_frames(std::uint32_t)
+    {
+        return loop_frames_32_;
+    }
+
+    sched::LoopFrames<std::uint64_t>& loop_frames(std::uint64_t)
+    {
+        return loop_frames_64_;
+    }
+
+    //! waits for a latch from any thread. The waiting thread runs queued
+    //! tasks while there are any, so waiting inside a task doesn't block a
+    //! worker.
+    void wait_for(sched::Latch& latch)
+    {
+        const auto id = task_manager_.own_worker();
+        const auto queue = (id < workers_.size()) ? id : 0;
+        std::function<void()> task;
+        while (!latch.done()) {
+            if (task_manager_.try_pop(task, queue)) {
+                this->execute_safely(task);
+            } else if (task_manager_.try_join()) {
+                continue;
+            } else {
+                // All remaining work is running on other threads.
+                break;
+            }
+        }
+        latch.wait();
+    }
+
+    //! number of blocks for two-pass algorithms over `size` elements: one
+    //! per active thread.
+    size_t num_blocks(size_t size) const
+    {
+        return std::max(
+          std::min(active_threads_.load(mem::relaxed), size),
+          static_cast<size_t>(1));
+    }
+
+    //! first pass of a parallel scan: reduces all blocks in parallel.
+    //! @return inclusive prefix scan of the block results.
+    template<class T, class InputIt, class BinaryOperation>
+    std::vector<T> scan_block_sums(InputIt first,
+                                   const loop::Blocks& blocks,
+                                   BinaryOperation& op)
+    {
+        std::vector<T> sums(blocks.count, *first);
+        this->parallel_for(static_cast<size_t>(0), blocks.count, [&](size_t b) {
+            auto it = first + static_cast<std::ptrdiff_t>(blocks.begin(b));
+            auto end = first + static_cast<std::ptrdiff_t>(blocks.end(b));
+            T acc = *it;
+            for (++it; it != end; ++it) {
+                acc = op(std::move(acc), *it);
+            }
+            sums[b] = std::move(acc);
+        });
+        for (size_t b = 1; b < blocks.count; ++b) {
+            sums[b] = op(sums[b - 1], sums[b]);
+        }
+        return sums;
+    }
+
+    //! first pass of parallel filters: evaluates `pred` for all elements and
+    //! counts the matches per block.
+    //! @param flags receives the outcome of `pred` for each element.
+    //! @return exclusive prefix scan of the block counts, with the total
+    //!   number of matches as last element.
+    template<class InputIt, class UnaryPredicate>
+    std::vector<size_t> count_if_blocks(InputIt first,
+                                        const loop::Blocks& blocks,
+                                        std::vector<unsigned char>& flags,
+                                        UnaryPredicate&& pred)
+    {
+        std::vector<size_t> offsets(blocks.count + 1, 0);
+        this->parallel_for(static_cast<size_t>(0), blocks.count, [&](size_t b) {
+            size_t count = 0;
+            for (auto i = blocks.begin(b); i < blocks.end(b); ++i) {
+                flags[i] = pred(first[static_cast<std::ptrdiff_t>(i)]) ? 1 : 0;
+                count += flags[i];
+            }
+            offsets[b + 1] = count;
+        });
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        return offsets;
+    }
+
+    //! moves the contents of a buffer to the front of a range in parallel.
+    template<class T, class RandomIt>
+    void move_from_buffer(mem::aligned::buffer<T>& buffer, RandomIt first)
+    {
+        this->parallel_for_range(
+          static_cast<size_t>(0), buffer.size, [&](size_t b, size_t e) {
+              std::move(buffer.data + b,
+                        buffer.data + e,
+                        first + static_cast<std::ptrdiff_t>(b));
+          });
+    }
+
+    //! finds how many of the first `k` elements of a stable merge of two
+    //! sorted ranges `a` and `b` come from `a` ("merge path" search).
+    template<class It, class Compare>
+    static size_t co_rank(size_t k,
+                          It a,
+                          size_t size_a,
+                          It b,
+                          size_t size_b,
+                          Compare& comp)
+    {
+        size_t lo = (k > size_b) ? k - size_b : 0;
+        size_t hi = std::min(k, size_a);
+        while (lo < hi) {
+            const auto i = lo + (hi - lo) / 2;
+            const auto j = k - i;
+            // a[i] precedes b[j - 1], so more elements must come from a.
+            if (!comp(b[static_cast<std::ptrdiff_t>(j - 1)],
+                      a[static_cast<std::ptrdiff_t>(i)])) {
+                lo = i + 1;
+            } else {
+                hi = i;
+            }
+        }
+        return lo;
+    }
+
+    //! merges pairs of sorted runs from `src` into `dst` in parallel.
+    //! @param bounds boundaries of the runs; updated to the merged runs.
+    template<class SrcIt, class DstIt, class Compare>
+    void merge_runs(SrcIt src,
+                    DstIt dst,
+                    std::vector<size_t>& bounds,
+                    Compare& comp)
+    {
+        // Split each merge into pieces of about equal size.
+        struct Piece
+        {
+            size_t begin, mid, end; // runs [begin, mid) and [mid, end)
+            size_t first, last;     // output range relative to begin
+            size_t split;           // elements taken from the first run
+        };
+        const auto size = bounds.back();
+        const auto piece_size = std::max(
+          size / (4 * std::max(active_threads_.load(), static_cast<size_t>(1))),
+          detail::sort_cutoff);
+        std::vector<Piece> pieces;
+        std::vector<size_t> merged_bounds{ 0 };
+        for (size_t r = 0; r + 1 < bounds.size(); r += 2) {
+            const auto begin = bounds[r];
+            const auto mid = bounds[r + 1];
+            const auto end = (r + 2 < bounds.size()) ? bounds[r + 2] : mid;
+            const loop::Blocks parts{ end - begin,
+                                      (end - begin + piece_size - 1) /
+                                        piece_size };
+            for (size_t p = 0; p < parts.count; ++p) {
+                pieces.push_back(
+                  Piece{ begin, mid, end, parts.begin(p), parts.end(p), 0 });
+            }
+            merged_bounds.push_back(end);
+        }
+
+        // Find all splits before moving any elements; the searches of one
+        // piece may look at elements merged by another.
+        const auto num_pieces = pieces.size();
+        this->parallel_for(static_cast<size_t>(0), num_pieces, [&](size_t p) {
+            auto& piece = pieces[p];
+            const auto a = src + static_cast<std::ptrdiff_t>(piece.begin);
+            const auto b = src + static_cast<std::ptrdiff_t>(piece.mid);
+            piece.split = co_rank(piece.first,
+                                  a,
+                                  piece.mid - piece.begin,
+                                  b,
+                                  piece.end - piece.mid,
+                                  comp);
+        });
+        this->parallel_for(static_cast<size_t>(0), num_pieces, [&](size_t p) {
+            const auto& piece = pieces[p];
+            const auto a = src + static_cast<std::ptrdiff_t>(piece.begin);
+            const auto b = src + static_cast<std::ptrdiff_t>(piece.mid);
+            const auto last_piece = (p + 1 == num_pieces) ||
+                                    (pieces[p + 1].begin != piece.begin);
+            const auto i0 = piece.split;
+            const auto i1 =
+              last_piece ? piece.mid - piece.begin : pieces[p + 1].split;
+            const auto j0 = piece.first - i0;
+            const auto j1 = piece.last - i1;
+            std::merge(
+              std::make_move_iterator(a + static_cast<std::ptrdiff_t>(i0)),
+              std::make_move_iterator(a + static_cast<std::ptrdiff_t>(i1)),
+              std::make_move_iterator(b + static_cast<std::ptrdiff_t>(j0)),
+              std::make_move_iterator(b + static_cast<std::ptrdiff_t>(j1)),
+              dst + static_cast<std::ptrdiff_t>(piece.begin + piece.first),
+              comp);
+        });
+        bounds = std::move(merged_bounds);
+    }
+
+    template<class Iterator, class UnaryFunction>
+    void parallel_for_each_impl(Iterator begin,
+                                Iterator end,
+                                UnaryFunction f,
+                                std::random_access_iterator_tag)
+    {
+        using difference_type =
+          typename std::iterator_traits<Iterator>::difference_type;
+        this->parallel_for(
+          static_cast<difference_type>(0), end - begin, [=](difference_type i) {
+              f(begin[i]);
+          });
+    }
+
+    //! Without random access, every loop worker (one per active thread and
+    //! one for the calling thread) repeatedly claims the next block of a
+    //! shared `Stream` and processes it. Work starts right away and no memory
+    //! proportional to the size of the range is needed. The loop indices are
+    //! workers rather than work, so all active threads join.
+    template<class Iterator, class UnaryFunction, class IteratorCategory>
+    void parallel_for_each_impl(Iterator begin,
+                                Iterator end,
+                                UnaryFunction f,
+                                IteratorCategory)
+    {
+        // run_loop() joins before returning, so the stream can live here.
+        loop::Stream<Iterator> stream(begin, end);
+        const auto num_workers = active_threads_.load(mem::relaxed) + 1;
+        auto drain = [&stream, f](size_t, size_t, size_t) {
+            Iterator it;
+            size_t count;
+            while (stream.next(it, count)) {
+                try {
+                    for (; count > 0; --count, ++it) {
+                        f(*it);
+                    }
+                } catch (...) {
+                    stream.stop();
+                    throw;
+                }
+            }
+        };
+        this->run_loop(static_cast<size_t>(0), num_workers, 1, drain);
+    }
+
+    //! joins all worker threads.
+    void join_threads()
+    {
+        for (auto& worker : workers_) {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+    //! pool the current thread works for; `nullptr` if the current thread
+    //! isn't a pool worker.
+    static ThreadPool*& this_worker_pool()
+    {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    //! adds one worker thread to the thread pool.
+    //! @param id worker id (used for matching threads with queues and cores)
+    void add_worker(size_t id)
+    {
+        workers_[id] = std::thread([&, id] {
+            sched::this_worker_id() = id;
+            sched::this_worker_owner() = &task_manager_;
+            ThreadPool::this_worker_pool() = this;
+            std::function<void()> task;
+            while (!task_manager_.stopped()) {
+                task_manager_.wait_for_jobs();
+                do {
+                    // inner while to save some time calling done()
+                    while (task_manager_.try_pop(task, id))
+                        this->execute_safely(task);
+                } while (task_manager_.try_join() || !task_manager_.done());
+            }
+        });
+    }
+
+#if (defined __linux__)
+    //! sets thread affinity on linux.
+    void set_thread_affinity()
+    {
+        cpu_set_t cpuset;
+        auto avail_cores = sched::get_avail_cores();
+        for (size_t id = 0; id < workers_.size(); id++) {
+            CPU_ZERO(&cpuset);
+            CPU_SET(avail_cores[id % avail_cores.size()], &cpuset);
+            int rc = pthread_setaffinity_np(
+              workers_.at(id).native_handle(), sizeof(cpu_set_t), &cpuset);
+            if (rc != 0) {
+                throw std::runtime_error(
+                  "Error calling pthread_setaffinity_np");
+            }
+        }
     }
+#endif
 
-    //! @brief computes an iterator-based parallel for loop.
-    //!
-    //! Waits until all tasks have finished, unless called from a thread
-    //! that didn't create the pool. If this is taken into account, parallel
-    //! loops can be nested.
-    //!
-    //! @param items an object allowing for `std::begin()` and `std::end()`.
-    //! @param f function to be applied as `f(*it)` for the iterator in the
-    //! range `[begin, end)` (the 'loop body').
-    template<class Items, class UnaryFunction>
-    inline void parallel_for_each(Items& items, UnaryFunction f)
+    void execute_safely(std::function<void()>& task)
     {
-        auto begin = std::begin(items);
-        auto size = std::distance(begin, std::end(items));
-        if (size <= 0) {
+        try {
+            task();
+            task_manager_.report_success();
+        } catch (...) {
+            task_manager_.report_fail(std::current_exception());
+        }
+    }
+
+    sched::TaskManager task_manager_;
+    std::vector<std::thread> workers_;
+    std::atomic_size_t active_threads_{ 0 };
+    sched::LoopFrames<std::uint32_t> loop_frames_32_;
+    sched::LoopFrames<std::uint64_t> loop_frames_64_;
+};
+
+inline ForkJoin::ForkJoin()
+  : ForkJoin(ThreadPool::global_instance())
+{}
+
+inline ForkJoin::ForkJoin(ThreadPool& pool)
+  : pool_{ pool }
+{}
+
+inline ForkJoin::~ForkJoin()
+{
+    pool_.wait_for(latch_);
+}
+
+template<class Function>
+void
+ForkJoin::spawn(Function&& f)
+{
+    using Task = typename std::decay<Function>::type;
+    latch_.count_up();
+    if (pool_.active_threads_ == 0) {
+        Task task(std::forward<Function>(f));
+        ForkJoin::run(latch_, task);
+        return;
+    }
+    auto latch = &latch_;
+    try {
+        pool_.push_local([latch, f]() mutable { ForkJoin::run(*latch, f); });
+    } catch (...) {
+        latch_.count_down();
+        throw;
+    }
+}
+
+inline TaskGroup::TaskGroup()
+  : TaskGroup(ThreadPool::global_instance())
+{}
+
+inline TaskGroup::TaskGroup(ThreadPool& pool)
+  : pool_{ pool }
+{}
+
+inline TaskGroup::~TaskGroup()
+{
+    pool_.wait_for(latch_);
+}
+
+template<class Function, class... Args>
+void
+TaskGroup::push(Function&& f, Args&&... args)
+{
+    auto task = detail::Task<Function, Args...>::make(
+      std::forward<Function>(f), std::forward<Args>(args)...);
+    latch_.count_up();
+    if (pool_.active_threads_ == 0) {
+        TaskGroup::run(*this, task);
+        return;
+    }
+    auto group = this;
+    try {
+        pool_.push_local(
+          [group, task]() mutable { TaskGroup::run(*group, task); });
+    } catch (...) {
+        latch_.count_down();
+        throw;
+    }
+}
+
+inline void
+TaskGroup::wait()
+{
+    pool_.wait_for(latch_);
+    this->rearm();
+}
+
+inline void
+TaskGroup::rearm()
+{
+    cancelled_ = false;
+    auto error = latch_.error();
+    if (error) {
+        latch_.reset(0);
+        std::rethrow_exception(error);
+    }
+}
+
+inline void
+ForkJoin::sync()
+{
+    pool_.wait_for(latch_);
+    auto error = latch_.error();
+    if (error) {
+        latch_.reset(0);
+        std::rethrow_exception(error);
+    }
+}
+
+inline TaskGraph::TaskGraph()
+  : TaskGraph(ThreadPool::global_instance())
+{}
+
+inline TaskGraph::TaskGraph(ThreadPool& pool)
+  : pool_{ pool }
+{}
+
+template<class Function>
+size_t
+TaskGraph::add(Function&& f)
+{
+    nodes_.emplace_back();
+    nodes_.back().f = std::forward<Function>(f);
+    prepared_ = false;
+    return nodes_.size() - 1;
+}
+
+inline void
+TaskGraph::precede(size_t before, size_t after)
+{
+    if (std::max(before, after) >= nodes_.size()) {
+        throw std::out_of_range("TaskGraph::precede(): no such node");
+    }
+    nodes_[before].successors.push_back(after);
+    nodes_[after].predecessors++;
+    prepared_ = false;
+}
+
+inline void
+TaskGraph::prepare()
+{
+    // Kahn's algorithm: order_ starts with the nodes without predecessors
+    // and is complete only if there is no cycle.
+    const auto n = nodes_.size();
+    std::vector<size_t> missing(n);
+    order_.clear();
+    order_.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        missing[i] = nodes_[i].predecessors;
+        if (missing[i] == 0) {
+            order_.push_back(i);
+        }
+    }
+    sources_ = order_.size();
+    for (size_t k = 0; k < order_.size(); ++k) {
+        for (auto s : nodes_[order_[k]].successors) {
+            if (--missing[s] == 0) {
+                order_.push_back(s);
+            }
+        }
+    }
+    if (order_.size() < n) {
+        throw std::invalid_argument("TaskGraph contains a cycle");
+    }
+    pending_.reset(new std::atomic<size_t>[n]);
+    prepared_ = true;
+}
+
+inline void
+TaskGraph::run()
+{
+    if (!prepared_) {
+        this->prepare();
+    }
+    if (nodes_.empty()) {
+        return;
+    }
+    if (pool_.active_threads_ == 0) {
+        for (auto node : order_) {
+            nodes_[node].f();
+        }
+        return;
+    }
+
+    // The counters are published to the workers by pushing the sources.
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        pending_[i].store(nodes_[i].predecessors, mem::relaxed);
+    }
+    latch_.reset(nodes_.size());
+    for (size_t k = 1; k < sources_; ++k) {
+        this->spawn(order_[k]);
+    }
+    this->execute(order_[0]);
+    pool_.wait_for(latch_);
+    auto error = latch_.error();
+    if (error) {
+        latch_.reset(0);
+        std::rethrow_exception(error);
+    }
+}
+
+inline void
+TaskGraph::execute(size_t node)
+{
+    constexpr size_t none = std::numeric_limits<size_t>::max();
+    while (node != none) {
+        if (!latch_.has_errored()) {
+            try {
+                nodes_[node].f();
+            } catch (...) {
+                latch_.report_fail(std::current_exception());
+            }
+        }
+        auto next = none;
+        for (auto s : nodes_[node].successors) {
+            if (pending_[s].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                if (next == none) {
+                    next = s;
+                } else {
+                    this->spawn(s);
+                }
+            }
+        }
+        // Unfinished successors keep the latch from completing, so the
+        // graph stays alive while we continue with `next`.
+        latch_.count_down();
+        node = next;
+    }
+}
+
+inline void
+TaskGraph::spawn(size_t node)
+{
+    auto graph = this;
+    try {
+        pool_.push_local([graph, node] { graph->execute(node); });
+    } catch (...) {
+        this->execute(node);
+    }
+}
+
+namespace sched {
+
+inline void
+schedule(ThreadPool& pool, FutureNode* node)
+{
+    if (pool.active_threads_ == 0) {
+        node->run();
+        return;
+    }
+    try {
+        pool.push_local([node] { node->run(); });
+    } catch (...) {
+        node->run();
+    }
+}
+
+//! State of a future computed by a continuation of another future. Runs on
+//! the pool once the other future is ready.
+template<class R, class T, class Function>
+class ThenState : public FutureState<R>
+{
+  public:
+    template<class F>
+    ThenState(FutureState<T>* parent, F&& f)
+      : FutureState<R>(parent->pool())
+      , parent_{ parent }
+      , f_(std::forward<F>(f))
+    {}
+
+    ~ThenState() override { parent_->release(); }
+
+    void notify() override { schedule(*this->pool(), this); }
+
+    void run() override
+    {
+        try {
+            this->set_value(this->call(*parent_));
+        } catch (...) {
+            this->set_error(std::current_exception());
+        }
+        this->release();
+    }
+
+  private:
+    template<class U>
+    typename FutureState<R>::Value call(FutureState<U>& parent)
+    {
+        return Call<R>::call(f_, parent.take());
+    }
+
+    typename FutureState<R>::Value call(FutureState<void>& parent)
+    {
+        parent.take();
+        return Call<R>::call(f_);
+    }
+
+    FutureState<T>* parent_;
+    Function f_;
+};
+
+//! State of `when_all()`: ready once all futures it is attached to are.
+template<class T>
+class WhenAllState : public FutureState<std::vector<Future<T>>>
+{
+  public:
+    WhenAllState(ThreadPool* pool, std::vector<Future<T>>&& futures)
+      : FutureState<std::vector<Future<T>>>(pool)
+      , futures_{ std::move(futures) }
+      , remaining_{ futures_.size() + 1 }
+    {}
+
+    std::vector<Future<T>>& futures() { return futures_; }
+
+    void notify() override
+    {
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->set_value(std::move(futures_));
+        }
+        this->release();
+    }
+
+    //! called once the state is attached to all futures.
+    void start()
+    {
+        this->retain();
+        this->notify();
+    }
+
+  private:
+    std::vector<Future<T>> futures_;
+    std::atomic<size_t> remaining_;
+};
+
+//! State of `when_any()`: ready once one of the futures it is attached to
+//! is.
+template<class T>
+class WhenAnyState : public FutureState<WhenAny<T>>
+{
+  public:
+    WhenAnyState(ThreadPool* pool, std::vector<Future<T>>&& futures)
+      : FutureState<WhenAny<T>>(pool)
+      , futures_{ std::move(futures) }
+    {}
+
+    std::vector<Future<T>>& futures() { return futures_; }
+
+    void notify() override
+    {
+        if (!fired_.exchange(true, std::memory_order_acq_rel)) {
+            this->open();
+        }
+        this->release();
+    }
+
+    //! called once the state is attached to all futures.
+    void start()
+    {
+        if (futures_.empty()) {
+            auto none = std::numeric_limits<size_t>::max();
+            this->set_value(WhenAny<T>{ none, std::move(futures_) });
             return;
         }
-        if (size > std::numeric_limits<int>::max()) {
-            throw std::length_error("parallel_for_each range is too large");
+        this->open();
+    }
+
+  private:
+    //! The first ready future and `start()` both open the gate; only then
+    //! the futures may be moved.
+    void open()
+    {
+        if (gate_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            size_t index = 0;
+            while (!futures_[index].is_ready()) {
+                ++index;
+            }
+            this->set_value(WhenAny<T>{ index, std::move(futures_) });
         }
-        typedef typename std::iterator_traits<decltype(begin)>::iterator_category
-          iterator_category;
-        loop::parallel_for_each_impl(begin,
-                                     std::end(items),
-                                     static_cast<int>(size),
-                                     f,
-                                     *this,
-                                     iterator_category{});
     }
 
-    //! @brief waits for all jobs currently running on the thread
-    //! pool. Has no effect when called from threads other than the one that
-    //! created the pool.
-    //! @param millis if > 0: stops waiting after millis ms.
-    void wait(size_t millis = 0) { task_manager_.wait_for_finish(millis); }
+    std::vector<Future<T>> futures_;
+    std::atomic_bool fired_{ false };
+    std::atomic<int> gate_{ 2 };
+};
 
-    //! @brief Stops the pool, waits for all tasks to finish, resets to neutral 
-    // state, and rethrows an exception if one is pending.
-    void stop_and_reset()  
-    { 
-        task_manager_.report_fail(std::current_exception());
-        task_manager_.wait_for_finish();
-        task_manager_.rethrow_exception();
+} // end namespace sched
+
+template<class T>
+void
+Future<T>::wait()
+{
+    if (!state_->is_ready()) {
+        state_->pool()->wait_for(state_->latch());
+    }
+}
+
+template<class T>
+T
+Future<T>::get()
+{
+    this->wait();
+    Future<T> self(std::move(*this));
+    return static_cast<T>(self.state_->take());
+}
+
+template<class T>
+template<class Function>
+auto
+Future<T>::then(Function&& f)
+  -> Future<typename sched::Then<T, typename std::decay<Function>::type>::type>
+{
+    using F = typename std::decay<Function>::type;
+    using R = typename sched::Then<T, F>::type;
+    auto parent = state_;
+    auto state = new sched::ThenState<R, T, F>(parent, std::forward<Function>(f));
+    state_ = nullptr;
+    Future<R> result(state);
+    parent->attach(state);
+    return result;
+}
+
+#if QUICKPOOL_HAS_COROUTINES
+
+template<class T = void>
+class Task;
+
+namespace sched {
+
+inline void
+resume(ThreadPool& pool, std::coroutine_handle<> handle)
+{
+    if (pool.active_threads_ == 0) {
+        handle.resume();
+        return;
+    }
+    try {
+        pool.push_local([handle] { handle.resume(); });
+    } catch (...) {
+        handle.resume();
+    }
+}
+
+inline void
+wait_for(Latch& latch)
+{
+    if (auto pool = ThreadPool::this_worker_pool()) {
+        pool->wait_for(latch);
+    } else {
+        latch.wait();
+    }
+}
+
+//! Promise of a `Task`, independent of its result type. A task starts when
+//! it is awaited or `get()` is called, and on completion transfers control
+//! to the awaiting coroutine or counts down the latch `get()` blocks on.
+class PromiseBase
+{
+  public:
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template<class Promise>
+        std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<Promise> handle) noexcept
+        {
+            auto& promise = handle.promise();
+            if (promise.continuation) {
+                return promise.continuation;
+            }
+            promise.latch->count_down();
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() { error = std::current_exception(); }
+
+    std::coroutine_handle<> continuation{ nullptr };
+    Latch* latch{ nullptr };
+    std::exception_ptr error{ nullptr };
+};
+
+template<class T>
+class Promise : public PromiseBase
+{
+  public:
+    Task<T> get_return_object();
+
+    template<class U>
+    void return_value(U&& value)
+    {
+        value_.emplace(std::forward<U>(value));
+    }
+
+    T result()
+    {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value_);
     }
 
-    //! @brief checks whether all jobs are done.
-    bool done() const { return task_manager_.done(); }
+  private:
+    std::optional<T> value_;
+};
+
+template<>
+class Promise<void> : public PromiseBase
+{
+  public:
+    Task<void> get_return_object();
 
-    //! @brief allocator respecting memory alignment.
-    static void* operator new(size_t count)
+    void return_void() const noexcept {}
+
+    void result()
     {
-        return mem::aligned::alloc(alignof(ThreadPool), count);
+        if (error) {
+            std::rethrow_exception(error);
+        }
     }
+};
 
-    //! @brief deallocator respecting memory alignment.
-    static void operator delete(void* ptr) { mem::aligned::free(ptr); }
+} // end namespace sched
 
-  private:
-    //! joins all worker threads.
-    void join_threads()
+//! @brief A coroutine computing a value of type `T` (C++20 only).
+//!
+//! Tasks are lazy: they start when they are awaited with `co_await` (or
+//! `get()` is called) and run on the awaiting thread until they suspend,
+//! e.g., in `co_await pool.schedule()` or on a `Future` or `TaskGroup`.
+//! Suspended coroutines don't block a worker; they are resumed through the
+//! task queues of the pool, so idle workers can steal them. Exceptions
+//! propagate to the awaiting coroutine.
+template<class T>
+class Task
+{
+  public:
+    using promise_type = sched::Promise<T>;
+
+    //! @brief creates a task without coroutine.
+    Task() = default;
+
+    ~Task()
     {
-        for (auto& worker : workers_) {
-            if (worker.joinable())
-                worker.join();
+        if (handle_) {
+            handle_.destroy();
         }
     }
 
-    //! adds one worker thread to the thread pool.
-    //! @param id worker id (used for matching threads with queues and cores)
-    void add_worker(size_t id)
+    Task(Task&& other) noexcept
+      : handle_{ std::exchange(other.handle_, nullptr) }
+    {}
+
+    Task& operator=(Task&& other) noexcept
     {
-        workers_[id] = std::thread([&, id] {
-            std::function<void()> task;
-            while (!task_manager_.stopped()) {
-                task_manager_.wait_for_jobs(id);
-                do {
-                    // inner while to save some time calling done()
-                    while (task_manager_.try_pop(task, id))
-                        this->execute_safely(task);
-                } while (!task_manager_.done());
-            }
-        });
+        std::swap(handle_, other.handle_);
+        return *this;
     }
 
-#if (defined __linux__)
-    //! sets thread affinity on linux.
-    void set_thread_affinity()
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    //! @brief checks whether the task holds a coroutine.
+    bool valid() const { return static_cast<bool>(handle_); }
+
+    //! @brief `co_await task` runs the task and resumes the awaiting
+    //! coroutine with its result once the task has finished.
+    auto operator co_await() noexcept { return Awaiter{ handle_ }; }
+
+    //! @brief runs the task and blocks until it has finished; for use outside
+    //! of coroutines. Called from a pool worker, it runs queued tasks of that
+    //! pool while waiting, like `Future::get()`.
+    //! @return the value returned by the coroutine; rethrows its exception.
+    T get()
     {
-        cpu_set_t cpuset;
-        auto avail_cores = sched::get_avail_cores();
-        for (size_t id = 0; id < workers_.size(); id++) {
-            CPU_ZERO(&cpuset);
-            CPU_SET(avail_cores[id % avail_cores.size()], &cpuset);
-            int rc = pthread_setaffinity_np(
-              workers_.at(id).native_handle(), sizeof(cpu_set_t), &cpuset);
-            if (rc != 0) {
-                throw std::runtime_error(
-                  "Error calling pthread_setaffinity_np");
-            }
-        }
+        sched::Latch latch{ 1 };
+        handle_.promise().latch = &latch;
+        handle_.resume();
+        sched::wait_for(latch);
+        return handle_.promise().result();
     }
-#endif
 
-    void execute_safely(std::function<void()>& task)
+  private:
+    friend class sched::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle_{ handle }
+    {}
+
+    struct Awaiter
     {
-        try {
-            task();
-            task_manager_.report_success();
-        } catch (...) {
-            task_manager_.report_fail(std::current_exception());
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<> awaiting) noexcept
+        {
+            handle.promise().continuation = awaiting;
+            return handle;
         }
-    }
 
-    sched::TaskManager task_manager_;
-    std::vector<std::thread> workers_;
-    std::atomic_size_t active_threads_{ 0 };
+        T await_resume() { return handle.promise().result(); }
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    std::coroutine_handle<promise_type> handle_{ nullptr };
 };
 
+namespace sched {
+
+template<class T>
+Task<T>
+Promise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void>
+Promise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+} // end namespace sched
+
+#endif
+
 // 5. ---------------------------------------------------
 
 //! Free-standing functions (main API)
@@ -1212,6 +5221,28 @@ push(Function&& f, Args&&... args)
                                        std::forward<Args>(args)...);
 }
 
+//! @brief pushes `n` jobs running `f(0)`, ..., `f(n - 1)` to the global
+//! thread pool; see `ThreadPool::push_n()`.
+//! @param n number of jobs.
+//! @param f a function taking a `size_t` argument; copied for each job.
+template<class Function>
+inline void
+push_n(size_t n, Function&& f)
+{
+    ThreadPool::global_instance().push_n(n, std::forward<Function>(f));
+}
+
+//! @brief pushes jobs running `(*it)()` for all `first <= it < last` to the
+//! global thread pool; see `ThreadPool::push_bulk()`.
+//! @param first,last a range of functions without arguments; must be forward
+//! iterators.
+template<class Iterator>
+inline void
+push_bulk(Iterator first, Iterator last)
+{
+    ThreadPool::global_instance().push_bulk(first, last);
+}
+
 //! @brief executes a job asynchronously the global thread pool.
 //! @param f a function.
 //! @param args (optional) arguments passed to `f`.
@@ -1226,6 +5257,67 @@ async(Function&& f, Args&&... args)
                                                std::forward<Args>(args)...);
 }
 
+//! @brief executes a job asynchronously on the global thread pool.
+//! @param f a function.
+//! @param args (optional) arguments passed to `f`.
+//! @return A `Future` for the result of `f(args...)`, which can be continued
+//! with `then()`, `when_all()`, and `when_any()`.
+template<class Function, class... Args>
+inline auto
+submit(Function&& f, Args&&... args)
+  -> Future<typename detail::Task<Function, Args...>::type>
+{
+    return ThreadPool::global_instance().submit(std::forward<Function>(f),
+                                                std::forward<Args>(args)...);
+}
+
+#if QUICKPOOL_HAS_COROUTINES
+//! @brief returns an awaitable that moves the awaiting coroutine to the
+//! global thread pool: `co_await schedule();`.
+inline auto
+schedule() noexcept
+{
+    return ThreadPool::global_instance().schedule();
+}
+#endif
+
+//! @brief combines futures into one that is ready once all of them are.
+//! @param futures futures, which are consumed.
+//! @return A future for the (ready) input futures.
+template<class T>
+Future<std::vector<Future<T>>>
+when_all(std::vector<Future<T>> futures)
+{
+    auto pool = futures.empty() ? &ThreadPool::global_instance()
+                                : futures.front().state_->pool();
+    auto state = new sched::WhenAllState<T>(pool, std::move(futures));
+    Future<std::vector<Future<T>>> result(state);
+    for (auto& future : state->futures()) {
+        future.state_->attach(state);
+    }
+    state->start();
+    return result;
+}
+
+//! @brief combines futures into one that is ready once one of them is.
+//! @param futures futures, which are consumed.
+//! @return A future for the input futures and the index of a ready one
+//! (the maximal `size_t` if `futures` is empty).
+template<class T>
+Future<WhenAny<T>>
+when_any(std::vector<Future<T>> futures)
+{
+    auto pool = futures.empty() ? &ThreadPool::global_instance()
+                                : futures.front().state_->pool();
+    auto state = new sched::WhenAnyState<T>(pool, std::move(futures));
+    Future<WhenAny<T>> result(state);
+    for (auto& future : state->futures()) {
+        future.state_->attach(state);
+    }
+    state->start();
+    return result;
+}
+
 //! @brief waits for all jobs currently running on the global thread pool.
 //! Has no effect when not called from main thread.
 inline void
@@ -1258,28 +5350,470 @@ get_active_threads()
     return ThreadPool::global_instance().get_active_threads();
 }
 
+//! @brief sets how the workers of the global thread pool wait for new tasks.
+//! @param policy see `ThreadPool::set_idle_policy()`.
+inline void
+set_idle_policy(IdlePolicy policy)
+{
+    ThreadPool::global_instance().set_idle_policy(policy);
+}
+
+//! @brief retrieves how the workers of the global thread pool wait for new
+//! tasks.
+inline IdlePolicy
+get_idle_policy()
+{
+    return ThreadPool::global_instance().get_idle_policy();
+}
+
+//! @brief runs functions in parallel on the global thread pool and waits for
+//! all of them.
+//! @param fs functions without arguments.
+//! @throws the first exception thrown by one of the functions.
+template<class... Functions>
+inline void
+parallel_invoke(Functions&&... fs)
+{
+    ThreadPool::global_instance().parallel_invoke(
+      std::forward<Functions>(fs)...);
+}
+
 //! @brief computes an index-based parallel for loop.
 //!
-//! Waits until all tasks have finished, unless called from a thread that
-//! didn't create the pool. If this is taken into account, parallel loops
-//! can be nested.
+//! Waits until the loop has finished. The waiting thread works on the loop and
+//! runs other queued tasks in the meantime, so parallel loops can be nested
+//! from any thread.
 //!
 //! @param begin first index of the loop.
 //! @param end the loop runs in the range `[begin, end)`.
-//! @param f a function taking `int` argument (the 'loop body').
-template<class UnaryFunction>
+//! @param f a function taking an index argument (the 'loop body'). Indices
+//! have the common type of `begin` and `end`, which can be any integer type.
+template<class Begin,
+         class End,
+         class UnaryFunction,
+         class Index = loop::index_t<Begin, End>>
 inline void
-parallel_for(int begin, int end, UnaryFunction&& f)
+parallel_for(Begin begin, End end, UnaryFunction&& f)
 {
     ThreadPool::global_instance().parallel_for(
       begin, end, std::forward<UnaryFunction>(f));
 }
 
+//! @brief computes an index-based parallel for loop in chunks.
+//!
+//! Same as `parallel_for(begin, end, f)`, but workers claim `grain_size`
+//! indices at once. This reduces scheduling overhead for tiny loop bodies.
+//!
+//! @param begin first index of the loop.
+//! @param end the loop runs in the range `[begin, end)`.
+//! @param f a function taking an index argument (the 'loop body').
+//! @param grain_size number of indices processed per chunk; 0 selects the
+//! chunk size automatically.
+template<class Begin,
+         class End,
+         class UnaryFunction,
+         class Index = loop::index_t<Begin, End>>
+inline void
+parallel_for(Begin begin, End end, UnaryFunction&& f, size_t grain_size)
+{
+    ThreadPool::global_instance().parallel_for(
+      begin, end, std::forward<UnaryFunction>(f), grain_size);
+}
+
+//! @brief computes a chunked parallel for loop with a range body.
+//!
+//! The loop body is called as `f(chunk_begin, chunk_end)` for disjoint chunks
+//! covering `[begin, end)`, so it can run a tight inner loop. Waits until the
+//! loop has finished.
+//!
+//! @param begin first index of the loop.
+//! @param end the loop runs in the range `[begin, end)`.
+//! @param f a function taking two index arguments `chunk_begin` and
+//! `chunk_end`.
+//! @param grain_size maximal number of indices per chunk; 0 (default) selects
+//! the chunk size automatically.
+template<class Begin,
+         class End,
+         class RangeFunction,
+         class Index = loop::index_t<Begin, End>>
+inline void
+parallel_for_range(Begin begin,
+                   End end,
+                   RangeFunction&& f,
+                   size_t grain_size = 0)
+{
+    ThreadPool::global_instance().parallel_for_range(
+      begin, end, std::forward<RangeFunction>(f), grain_size);
+}
+
+//! @brief computes a parallel for loop on the global thread pool that
+//! replays the thread assignment of earlier loops.
+//!
+//! Same as `parallel_for(begin, end, f)`, but each subrange is sent to the
+//! worker that processed it in the last loop run with the same partitioner.
+//!
+//! @param begin first index of the loop.
+//! @param end the loop runs in the range `[begin, end)`.
+//! @param f a function taking an index argument (the 'loop body').
+//! @param partitioner records and replays the thread assignment.
+template<class Begin,
+         class End,
+         class UnaryFunction,
+         class Index = loop::index_t<Begin, End>>
+inline void
+parallel_for(Begin begin,
+             End end,
+             UnaryFunction&& f,
+             AffinityPartitioner& partitioner)
+{
+    ThreadPool::global_instance().parallel_for(
+      begin, end, std::forward<UnaryFunction>(f), partitioner);
+}
+
+//! @brief computes a chunked parallel for loop with a range body on the
+//! global thread pool that replays the thread assignment of earlier loops.
+//!
+//! @param begin first index of the loop.
+//! @param end the loop runs in the range `[begin, end)`.
+//! @param f a function taking two index arguments `chunk_begin` and
+//! `chunk_end`.
+//! @param partitioner records and replays the thread assignment.
+template<class Begin,
+         class End,
+         class RangeFunction,
+         class Index = loop::index_t<Begin, End>>
+inline void
+parallel_for_range(Begin begin,
+                   End end,
+                   RangeFunction&& f,
+                   AffinityPartitioner& partitioner)
+{
+    ThreadPool::global_instance().parallel_for_range(
+      begin, end, std::forward<RangeFunction>(f), partitioner);
+}
+
+//! @brief computes a parallel for loop on the global thread pool that adapts
+//! to the cost of its body; see `ThreadPool::parallel_for()`.
+//!
+//! @param begin first index of the loop.
+//! @param end the loop runs in the range `[begin, end)`.
+//! @param f a function taking an index argument (the 'loop body').
+//! @param partitioner learns the cost of `f`.
+template<class Begin,
+         class End,
+         class UnaryFunction,
+         class Index = loop::index_t<Begin, End>>
+inline void
+parallel_for(Begin begin,
+             End end,
+             UnaryFunction&& f,
+             AdaptivePartitioner& partitioner)
+{
+    ThreadPool::global_instance().parallel_for(
+      begin, end, std::forward<UnaryFunction>(f), partitioner);
+}
+
+//! @brief computes a chunked parallel for loop with a range body on the
+//! global thread pool that adapts to the cost of its body.
+//!
+//! @param begin first index of the loop.
+//! @param end the loop runs in the range `[begin, end)`.
+//! @param f a function taking two index arguments `chunk_begin` and
+//! `chunk_end`.
+//! @param partitioner learns the cost of `f`.
+template<class Begin,
+         class End,
+         class RangeFunction,
+         class Index = loop::index_t<Begin, End>>
+inline void
+parallel_for_range(Begin begin,
+                   End end,
+                   RangeFunction&& f,
+                   AdaptivePartitioner& partitioner)
+{
+    ThreadPool::global_instance().parallel_for_range(
+      begin, end, std::forward<RangeFunction>(f), partitioner);
+}
+
+//! @brief computes a tiled parallel for loop over a 2D index space on the
+//! global thread pool.
+//!
+//! The space `[0, rows) x [0, cols)` is split into square tiles, which are
+//! ordered along a Morton curve. Loop workers own and steal whole tiles.
+//! Waits until the loop has finished.
+//!
+//! @param rows number of rows.
+//! @param cols number of columns.
+//! @param tile edge length of the tiles.
+//! @param f a function called as `f(row_begin, row_end, col_begin, col_end)`
+//! for each tile.
+template<class TileFunction>
+inline void
+parallel_for_2d(size_t rows, size_t cols, size_t tile, TileFunction&& f)
+{
+    ThreadPool::global_instance().parallel_for_2d(
+      rows, cols, tile, std::forward<TileFunction>(f));
+}
+
+//! @brief computes a tiled parallel for loop over a 3D index space on the
+//! global thread pool.
+//!
+//! @param n0,n1,n2 extents of the three dimensions.
+//! @param tile edge length of the tiles.
+//! @param f a function called as `f(b0, e0, b1, e1, b2, e2)` for each tile
+//! `[b0, e0) x [b1, e1) x [b2, e2)`.
+template<class TileFunction>
+inline void
+parallel_for_3d(size_t n0, size_t n1, size_t n2, size_t tile, TileFunction&& f)
+{
+    ThreadPool::global_instance().parallel_for_3d(
+      n0, n1, n2, tile, std::forward<TileFunction>(f));
+}
+
+//! @brief computes a parallel reduction over an index range on the global
+//! thread pool.
+//!
+//! Each loop worker accumulates a private, cache-line-aligned partial result;
+//! the partials are merged in a final tree combine.
+//!
+//! @param begin first index of the loop.
+//! @param end the loop runs in the range `[begin, end)`.
+//! @param identity identity element of `combine`; initial value of all
+//! partial results.
+//! @param map a function computing the contribution `map(i)` of index `i`.
+//! @param combine a function merging two partial results; must be associative
+//! and commutative.
+//! @param grain_size number of indices processed per chunk; 0 (default)
+//! selects the chunk size automatically.
+//! @return the reduction `combine(identity, map(begin), ...)`.
+template<class Begin,
+         class End,
+         class T,
+         class MapFunction,
+         class CombineFunction,
+         class Index = loop::index_t<Begin, End>>
+inline T
+parallel_reduce(Begin begin,
+                End end,
+                T identity,
+                MapFunction&& map,
+                CombineFunction&& combine,
+                size_t grain_size = 0)
+{
+    return ThreadPool::global_instance().parallel_reduce(
+      begin,
+      end,
+      std::move(identity),
+      std::forward<MapFunction>(map),
+      std::forward<CombineFunction>(combine),
+      grain_size);
+}
+
+//! @brief computes an inclusive prefix scan in parallel on the global thread
+//! pool.
+//!
+//! Writes `x[0]`, `op(x[0], x[1])`, ... to `d_first`. Works in two passes over
+//! one contiguous block per active thread.
+//!
+//! @param first,last random access iterators to the input range.
+//! @param d_first random access iterator to the output range; may be equal to
+//! `first`.
+//! @param op an associative binary operation.
+//! @return iterator to the element past the last element written.
+template<class InputIt, class OutputIt, class BinaryOperation>
+inline OutputIt
+parallel_inclusive_scan(InputIt first,
+                        InputIt last,
+                        OutputIt d_first,
+                        BinaryOperation op)
+{
+    return ThreadPool::global_instance().parallel_inclusive_scan(
+      first, last, d_first, std::move(op));
+}
+
+//! @brief computes an inclusive prefix sum in parallel on the global thread
+//! pool.
+//! @param first,last random access iterators to the input range.
+//! @param d_first random access iterator to the output range; may be equal to
+//! `first`.
+//! @return iterator to the element past the last element written.
+template<class InputIt, class OutputIt>
+inline OutputIt
+parallel_inclusive_scan(InputIt first, InputIt last, OutputIt d_first)
+{
+    return ThreadPool::global_instance().parallel_inclusive_scan(
+      first, last, d_first);
+}
+
+//! @brief computes an exclusive prefix scan in parallel on the global thread
+//! pool.
+//!
+//! Writes `init`, `op(init, x[0])`, `op(op(init, x[0]), x[1])`, ... to
+//! `d_first`. Works in two passes over one contiguous block per active thread.
+//!
+//! @param first,last random access iterators to the input range.
+//! @param d_first random access iterator to the output range; may be equal to
+//! `first`.
+//! @param init initial value.
+//! @param op an associative binary operation.
+//! @return iterator to the element past the last element written.
+template<class InputIt, class OutputIt, class T, class BinaryOperation>
+inline OutputIt
+parallel_exclusive_scan(InputIt first,
+                        InputIt last,
+                        OutputIt d_first,
+                        T init,
+                        BinaryOperation op)
+{
+    return ThreadPool::global_instance().parallel_exclusive_scan(
+      first, last, d_first, std::move(init), std::move(op));
+}
+
+//! @brief computes an exclusive prefix sum in parallel on the global thread
+//! pool.
+//! @param first,last random access iterators to the input range.
+//! @param d_first random access iterator to the output range; may be equal to
+//! `first`.
+//! @param init initial value.
+//! @return iterator to the element past the last element written.
+template<class InputIt, class OutputIt, class T>
+inline OutputIt
+parallel_exclusive_scan(InputIt first, InputIt last, OutputIt d_first, T init)
+{
+    return ThreadPool::global_instance().parallel_exclusive_scan(
+      first, last, d_first, std::move(init));
+}
+
+//! @brief sorts a range in parallel on the global thread pool.
+//!
+//! A parallel merge sort: one block per active thread is sorted with
+//! `std::sort()`, then sorted runs are merged pairwise in parallel. Small
+//! ranges are sorted serially. The sort is not stable.
+//!
+//! @param first,last random access iterators to the range.
+//! @param comp comparison function object (strict weak ordering).
+template<class RandomIt, class Compare>
+inline void
+parallel_sort(RandomIt first, RandomIt last, Compare comp)
+{
+    ThreadPool::global_instance().parallel_sort(first, last, std::move(comp));
+}
+
+//! @brief sorts a range in ascending order in parallel on the global thread
+//! pool.
+//! @param first,last random access iterators to the range.
+template<class RandomIt>
+inline void
+parallel_sort(RandomIt first, RandomIt last)
+{
+    ThreadPool::global_instance().parallel_sort(first, last);
+}
+
+//! @brief copies the elements satisfying a predicate in parallel on the
+//! global thread pool.
+//!
+//! Runs in two passes: each block counts its matches, then all blocks copy
+//! their matches to offsets given by a scan over the counts. The relative
+//! order of elements is preserved.
+//!
+//! @param first,last random access iterators to the input range.
+//! @param d_first random access iterator to the beginning of the output range;
+//!   must not overlap with the input.
+//! @param pred unary predicate.
+//! @return iterator to the element past the last element copied.
+template<class InputIt, class OutputIt, class UnaryPredicate>
+inline OutputIt
+parallel_copy_if(InputIt first,
+                 InputIt last,
+                 OutputIt d_first,
+                 UnaryPredicate pred)
+{
+    return ThreadPool::global_instance().parallel_copy_if(
+      first, last, d_first, std::move(pred));
+}
+
+//! @brief removes the elements satisfying a predicate in parallel on the
+//! global thread pool.
+//!
+//! Kept elements are moved to the front of the range in their original order.
+//!
+//! @param first,last random access iterators to the range.
+//! @param pred unary predicate returning `true` for elements to remove.
+//! @return iterator to the new end of the range.
+template<class RandomIt, class UnaryPredicate>
+inline RandomIt
+parallel_remove_if(RandomIt first, RandomIt last, UnaryPredicate pred)
+{
+    return ThreadPool::global_instance().parallel_remove_if(
+      first, last, std::move(pred));
+}
+
+//! @brief partitions a range in parallel on the global thread pool.
+//!
+//! Moves all elements satisfying `pred` before all other elements, preserving
+//! the relative order within both groups.
+//!
+//! @param first,last random access iterators to the range.
+//! @param pred unary predicate.
+//! @return iterator to the first element of the second group.
+template<class RandomIt, class UnaryPredicate>
+inline RandomIt
+parallel_partition(RandomIt first, RandomIt last, UnaryPredicate pred)
+{
+    return ThreadPool::global_instance().parallel_partition(
+      first, last, std::move(pred));
+}
+
+//! @brief finds the first element satisfying a predicate in parallel on the
+//! global thread pool.
+//!
+//! Workers stop searching after a match, but the result is the same as for
+//! `std::find_if()`.
+//!
+//! @param first,last random access iterators to the range.
+//! @param pred unary predicate.
+//! @return iterator to the first element satisfying `pred`, or `last` if
+//! there is none.
+template<class RandomIt, class UnaryPredicate>
+inline RandomIt
+parallel_find_if(RandomIt first, RandomIt last, UnaryPredicate pred)
+{
+    return ThreadPool::global_instance().parallel_find_if(
+      first, last, std::move(pred));
+}
+
+//! @brief checks in parallel on the global thread pool whether an element
+//! satisfies a predicate.
+//!
+//! @param first,last random access iterators to the range.
+//! @param pred unary predicate.
+//! @return `true` if `pred` returns `true` for some element.
+template<class RandomIt, class UnaryPredicate>
+inline bool
+parallel_any_of(RandomIt first, RandomIt last, UnaryPredicate pred)
+{
+    return ThreadPool::global_instance().parallel_any_of(
+      first, last, std::move(pred));
+}
+
+//! @brief checks in parallel on the global thread pool whether all elements
+//! satisfy a predicate.
+//!
+//! @param first,last random access iterators to the range.
+//! @param pred unary predicate.
+//! @return `true` if `pred` returns `true` for all elements (or the range is
+//! empty).
+template<class RandomIt, class UnaryPredicate>
+inline bool
+parallel_all_of(RandomIt first, RandomIt last, UnaryPredicate pred)
+{
+    return ThreadPool::global_instance().parallel_all_of(
+      first, last, std::move(pred));
+}
+
 //! @brief computes an iterator-based parallel for loop.
 //!
-//! Waits until all tasks have finished, unless called from a thread that
-//! didn't create the pool. If this is taken into account, parallel loops
-//! can be nested.
+//! Waits until the loop has finished, so parallel loops can be nested.
 //!
 //! @param items an object allowing for `std::begin()` and `std::end()`.
 //! @param f function to be applied as `f(*it)` for the iterator in the
@@ -1295,3 +5829,4 @@ parallel_for_each(Items& items, UnaryFunction&& f)
 } // end namespace quickpool
 
 #undef QUICKPOOL_HAS_CPP17
+#undef QUICKPOOL_HAS_COROUTINES
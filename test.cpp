@@ -1,15 +1,120 @@
 #include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <atomic>
+#include <exception>
+#include <forward_list>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <limits>
+#include <map>
+#include <mutex>
+#include <new>
+#include <numeric>
 #include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
 #include "quickpool.hpp"
 
+// counts heap allocations of the whole program
+std::atomic<size_t> allocations{ 0 };
+
+// The replacements pair malloc() with free(), which GCC mistakes for a
+// mismatch once they are inlined into each other.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void*
+operator new(std::size_t size)
+{
+    allocations++;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void*
+operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void
+operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+void
+operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+#if __cplusplus >= 201703L && defined(__cpp_impl_coroutine)
+quickpool::Task<int>
+coro_square(quickpool::ThreadPool& pool, int x)
+{
+    co_await pool.schedule();
+    co_return x * x;
+}
+
+// awaits tasks, futures, and task groups
+quickpool::Task<int>
+coro_sum(quickpool::ThreadPool& pool, int n)
+{
+    int sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum += co_await coro_square(pool, i);
+    sum += co_await pool.submit([] { return 1000; });
+    std::atomic_int count{ 0 };
+    quickpool::TaskGroup group(pool);
+    for (int i = 0; i < 10; ++i)
+        group.push([&] { count++; });
+    co_await group;
+    co_return sum + count;
+}
+
+quickpool::Task<std::thread::id>
+coro_thread(quickpool::ThreadPool& pool)
+{
+    co_await pool.schedule();
+    co_return std::this_thread::get_id();
+}
+
+// awaits a group that other coroutines may await, too
+quickpool::Task<>
+coro_await_group(quickpool::ThreadPool& pool,
+                 quickpool::TaskGroup& group,
+                 std::atomic_int& arrived)
+{
+    co_await pool.schedule();
+    arrived++;
+    co_await group;
+}
+
+quickpool::Task<>
+coro_throw(quickpool::ThreadPool& pool)
+{
+    co_await pool.schedule();
+    throw std::runtime_error("test error");
+}
+#endif
+
 int
 checked_size_int(size_t size)
 {
@@ -60,6 +165,30 @@ stress_queue_growth_and_reuse()
     }
 }
 
+void
+stress_deque_growth_and_stealing()
+{
+    using namespace quickpool;
+    const auto batches = 8;
+    const auto tasks = 4096;
+    ThreadPool pool(4);
+
+    // One worker fills its own deque far beyond its initial capacity while
+    // the others steal from it.
+    for (auto batch = 0; batch < batches; ++batch) {
+        std::atomic_int done{ 0 };
+        pool.push([&] {
+            for (auto i = 0; i < tasks; ++i) {
+                pool.push([&] { done++; });
+            }
+        });
+        pool.wait();
+        if (done != tasks) {
+            throw std::runtime_error("deque growth stress lost work");
+        }
+    }
+}
+
 void
 stress_concurrent_push_and_reuse()
 {
@@ -132,9 +261,10 @@ int
 main()
 {
     using namespace quickpool;
-    mem::aligned::atomic<loop::State> test{};
+    mem::aligned::atomic<loop::State<uint32_t>> test{};
     std::cout << "* [quickpool] lock free: "
-              << (test.is_lock_free() ? "yes\n" : "no\n");
+              << (test.is_lock_free() ? "yes" : "no") << " (64-bit ranges: "
+              << (loop::wide_state_is_lock_free() ? "yes" : "no") << ")\n";
 
     auto runs = 100;
     for (auto run = 0; run < runs; run++) {
@@ -172,6 +302,178 @@ main()
             // std::cout << "OK" << std::endl;
         }
 
+        // push_n(), push_bulk()
+        {
+            // std::cout << "      * push_n: ";
+            std::vector<size_t> x(10000, 1);
+            push_n(x.size(), [&](size_t i) { x[i] = 2 * x[i]; });
+            wait();
+            if (std::count(x.begin(), x.end(), 2) != 10000)
+                throw std::runtime_error("static push_n gives wrong result");
+
+            // fewer jobs than queues
+            ThreadPool pool(4);
+            std::atomic_size_t count{ 0 };
+            pool.push_n(3, [&](size_t i) { count += i + 1; });
+            pool.wait();
+            if (count != 6)
+                throw std::runtime_error("push_n gives wrong result");
+
+            std::list<std::function<void()>> jobs;
+            for (size_t i = 0; i < x.size(); i++)
+                jobs.push_back([&, i] { x[i]++; });
+            pool.push_bulk(jobs.begin(), jobs.end());
+            pool.wait();
+            if (std::count(x.begin(), x.end(), 3) != 10000)
+                throw std::runtime_error("push_bulk gives wrong result");
+
+            // A failing copy pushes the jobs copied before.
+            struct Job
+            {
+                Job(std::atomic_size_t& count, bool fail)
+                  : count(count)
+                  , fail(fail)
+                {}
+                Job(const Job& other)
+                  : count(other.count)
+                  , fail(other.fail)
+                {
+                    if (fail)
+                        throw std::runtime_error("copy failed");
+                }
+                void operator()() const { count++; }
+                std::atomic_size_t& count;
+                bool fail;
+            };
+            std::vector<Job> failing;
+            failing.reserve(10);
+            for (size_t i = 0; i < 10; i++)
+                failing.emplace_back(count, i == 5);
+            try {
+                pool.push_bulk(failing.begin(), failing.end());
+                throw std::runtime_error("copy failure was not thrown");
+            } catch (const std::runtime_error& e) {
+                if (std::string(e.what()) != "copy failed")
+                    throw;
+            }
+            pool.wait();
+            if (count != 11)
+                throw std::runtime_error("failed push_bulk loses jobs");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // push() from worker threads
+        {
+            // std::cout << "      * nested push: ";
+            // A worker runs the tasks it pushed itself most recent first.
+            ThreadPool single(1);
+            std::vector<int> order;
+            single.push([&] {
+                for (int i = 0; i < 3; ++i)
+                    single.push([&order, i] { order.push_back(i); });
+            });
+            single.wait();
+            if (order != std::vector<int>{ 2, 1, 0 })
+                throw std::runtime_error("nested push isn't LIFO");
+
+            // recursive spawning, the other workers steal
+            ThreadPool pool(4);
+            std::atomic_size_t count{ 0 };
+            std::function<void(size_t)> spawn = [&](size_t depth) {
+                count++;
+                for (size_t i = 0; depth > 0 && i < 2; ++i)
+                    pool.push([&spawn, depth] { spawn(depth - 1); });
+            };
+            pool.push([&] { spawn(12); });
+            pool.wait();
+            if (count != (1 << 13) - 1)
+                throw std::runtime_error("nested push loses tasks");
+
+            // workers of another pool push to the queues
+            ThreadPool other(2);
+            count = 0;
+            pool.push([&] {
+                for (int i = 0; i < 100; ++i)
+                    other.push([&] { count++; });
+            });
+            pool.wait();
+            other.wait();
+            if (count != 100)
+                throw std::runtime_error("push from another pool fails");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // push() from several threads
+        {
+            // std::cout << "      * push from several threads: ";
+            // While the worker is busy, the lane fills up and further tasks
+            // go to the queue.
+            ThreadPool pool(1);
+            std::atomic_bool busy{ false }, release{ false };
+            std::atomic_size_t count{ 0 };
+            pool.push([&] {
+                busy = true;
+                while (!release)
+                    std::this_thread::yield();
+            });
+            while (!busy)
+                std::this_thread::yield();
+            std::vector<std::thread> producers;
+            for (int p = 0; p < 4; ++p) {
+                producers.emplace_back([&] {
+                    for (int i = 0; i < 200; ++i)
+                        pool.push([&] { count++; });
+                });
+            }
+            for (auto& producer : producers)
+                producer.join();
+            release = true;
+            pool.wait();
+            if (count != 800)
+                throw std::runtime_error("concurrent push loses tasks");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // wake up idle workers
+        {
+            // std::cout << "      * wake up idle workers: ";
+            // Workers park between tasks; a lost wake up would hang wait().
+            ThreadPool pool(4);
+            std::atomic_size_t count{ 0 };
+            for (size_t i = 0; i < 1000; ++i) {
+                pool.push([&] { count++; });
+                pool.wait();
+                if (i % 100 == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (count != 1000)
+                throw std::runtime_error("idle workers miss tasks");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // idle policies
+        {
+            // std::cout << "      * idle policies: ";
+            ThreadPool pool(2, IdlePolicy::spin);
+            if (pool.get_idle_policy() != IdlePolicy::spin)
+                throw std::runtime_error("idle policy not set");
+            std::atomic_size_t count{ 0 };
+            for (auto policy :
+                 { IdlePolicy::block, IdlePolicy::poll, IdlePolicy::spin }) {
+                pool.set_idle_policy(policy);
+                for (size_t i = 0; i < 100; ++i) {
+                    pool.push([&] { count++; });
+                    pool.wait();
+                }
+            }
+            pool.set_active_threads(3);
+            if (pool.get_idle_policy() != IdlePolicy::spin)
+                throw std::runtime_error("idle policy lost on resize");
+            if (count != 300)
+                throw std::runtime_error("idle workers miss tasks");
+            // std::cout << "OK" << std::endl;
+        }
+
         // async()
         {
             // std::cout << "      * async: ";
@@ -251,6 +553,1027 @@ main()
             // std::cout << "OK" << std::endl;
         }
 
+        // chunked parallel_for()
+        {
+            // std::cout << "      * chunked parallel_for: ";
+            std::vector<size_t> x(10007, 1);
+            auto fun = [&](int i) {
+                auto idx = static_cast<size_t>(i);
+                x[idx] = 2 * x[idx];
+            };
+            parallel_for(0, checked_size_int(x.size()), fun, 64);
+
+            ThreadPool pool;
+            pool.parallel_for(0, checked_size_int(x.size()), fun, 0);
+
+            size_t count_wrong = 0;
+            for (size_t i = 0; i < x.size(); i++)
+                count_wrong += (x[i] != 4);
+            if (count_wrong > 0)
+                throw std::runtime_error(
+                  "chunked parallel_for gives wrong result");
+
+            std::atomic_int bad_chunks{ 0 };
+            auto range_fun = [&](int b, int e) {
+                if (b >= e || e - b > 100)
+                    bad_chunks++;
+                for (auto i = b; i < e; ++i)
+                    x[static_cast<size_t>(i)] += 1;
+            };
+            parallel_for_range(0, checked_size_int(x.size()), range_fun, 100);
+            pool.parallel_for_range(
+              0, checked_size_int(x.size()), range_fun, 100);
+            pool.parallel_for_range(0,
+                                    checked_size_int(x.size()),
+                                    [&](int b, int e) {
+                                        for (auto i = b; i < e; ++i)
+                                            x[static_cast<size_t>(i)] += 1;
+                                    });
+
+            count_wrong = 0;
+            for (size_t i = 0; i < x.size(); i++)
+                count_wrong += (x[i] != 7);
+            if (count_wrong > 0)
+                throw std::runtime_error(
+                  "parallel_for_range gives wrong result");
+            if (bad_chunks > 0)
+                throw std::runtime_error(
+                  "parallel_for_range exceeds grain size");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_for() with other index types
+        {
+            // std::cout << "      * parallel_for index types: ";
+            ThreadPool pool;
+            const auto max64 = std::numeric_limits<int64_t>::max();
+            std::atomic<int64_t> sum{ 0 };
+            pool.parallel_for(max64 - 1000, max64, [&](int64_t i) {
+                sum += max64 - i;
+            });
+            parallel_for(int64_t(-500), int64_t(500), [&](int64_t i) {
+                sum += i;
+            });
+            if (sum != 1000 * 1001 / 2 - 500)
+                throw std::runtime_error(
+                  "int64_t parallel_for gives wrong result");
+
+            std::vector<size_t> x(1000, 1);
+            pool.parallel_for(0, x.size(), [&](size_t i) { x[i]++; });
+            parallel_for(size_t(0), x.size(), [&](size_t i) { x[i]++; }, 7);
+            size_t count_wrong = 0;
+            for (size_t i = 0; i < x.size(); i++)
+                count_wrong += (x[i] != 3);
+            if (count_wrong > 0)
+                throw std::runtime_error(
+                  "size_t parallel_for gives wrong result");
+
+            // more than 2^32 indices
+            const auto n = int64_t(1) << 33;
+            std::atomic<int64_t> covered{ 0 };
+            pool.parallel_for_range(
+              int64_t(0),
+              n,
+              [&](int64_t b, int64_t e) { covered += e - b; },
+              size_t(1) << 26);
+            if (covered != n)
+                throw std::runtime_error(
+                  "large parallel_for_range gives wrong result");
+
+            loop::Chunks<int64_t> chunks{ 0, n, 1, 1 };
+            chunks.limit_count(std::numeric_limits<uint32_t>::max());
+            if (chunks.count > std::numeric_limits<uint32_t>::max() ||
+                chunks.end(chunks.count - 1) != n)
+                throw std::runtime_error("chunks are not limited correctly");
+
+            // workers with 32-bit positions
+            auto workers = loop::create_workers<uint32_t>(0, 1000, 3);
+            std::atomic<uint64_t> chunk_sum{ 0 };
+            for (size_t k = 0; k < workers->size(); ++k) {
+                pool.push([&, workers, k] {
+                    workers->at(k).run(*workers,
+                                       [&](uint32_t c) { chunk_sum += c; });
+                });
+            }
+            pool.wait();
+            if (chunk_sum != 999 * 1000 / 2)
+                throw std::runtime_error(
+                  "32-bit loop workers give wrong result");
+
+#if QUICKPOOL_HAS_WIDE_CAS
+            // workers with 64-bit positions, beyond the range of 32 bits
+            const uint64_t wide_begin = uint64_t(1) << 40;
+            auto wide_workers =
+              loop::create_workers<uint64_t>(wide_begin, wide_begin + 1000, 3);
+            std::atomic<uint64_t> wide_sum{ 0 };
+            for (size_t k = 0; k < wide_workers->size(); ++k) {
+                pool.push([&, wide_workers, k] {
+                    wide_workers->at(k).run(
+                      *wide_workers,
+                      [&](uint64_t c) { wide_sum += c - wide_begin; });
+                });
+            }
+            pool.wait();
+            if (wide_sum != 999 * 1000 / 2)
+                throw std::runtime_error(
+                  "64-bit loop workers give wrong result");
+#endif
+
+            // large teams pick victims at random
+            auto team = loop::create_workers<uint32_t>(0, 5000, 40);
+            std::vector<std::atomic_int> claims(5000);
+            for (auto& claim : claims)
+                claim = 0;
+            for (size_t k = 0; k < team->size(); ++k) {
+                pool.push([&, team, k] {
+                    team->at(k).run(*team, [&](uint32_t c) { claims[c]++; });
+                });
+            }
+            pool.wait();
+            for (const auto& claim : claims) {
+                if (claim != 1)
+                    throw std::runtime_error(
+                      "large team of loop workers gives wrong result");
+            }
+            if (!team->all_done())
+                throw std::runtime_error("large team of loop workers not done");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_for() from several threads
+        {
+            // std::cout << "      * parallel_for from several threads: ";
+            // only one loop at a time is published to all workers, the
+            // others push their jobs
+            ThreadPool pool(3);
+            std::vector<std::vector<int>> x(4, std::vector<int>(1000, 0));
+            std::vector<std::thread> callers;
+            for (size_t t = 0; t < x.size(); t++) {
+                callers.emplace_back([&, t] {
+                    for (int rep = 0; rep < 10; rep++) {
+                        pool.parallel_for(0, 1000, [&](int i) {
+                            x[t][static_cast<size_t>(i)]++;
+                        });
+                    }
+                });
+            }
+            for (auto& caller : callers)
+                caller.join();
+            for (const auto& xx : x) {
+                if (std::count(xx.begin(), xx.end(), 10) != 1000)
+                    throw std::runtime_error(
+                      "parallel_for from several threads gives wrong result");
+            }
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_for() without allocations
+        {
+            // std::cout << "      * parallel_for allocations: ";
+            ThreadPool pool(4);
+            std::vector<size_t> x(1000, 0);
+            // The body is expensive enough to make loops run in parallel.
+            auto fun = [&](int i) {
+                volatile int spin = 0;
+                while (spin < 100)
+                    spin = spin + 1;
+                x[static_cast<size_t>(i)]++;
+            };
+
+            // The first loop creates the loop frame and task nodes, later
+            // loops reuse them. Waiting for the pool ensures that all jobs
+            // have released the frame; otherwise the next loop may need a
+            // second one.
+            std::list<int> indices(1000);
+            std::iota(indices.begin(), indices.end(), 0);
+            pool.parallel_for(0, 1000, fun);
+            pool.wait();
+            const size_t before = allocations;
+            for (int rep = 0; rep < 20; rep++) {
+                pool.parallel_for(0, 1000, fun);
+                pool.wait();
+                pool.parallel_for_range(0, 1000, [&](int b, int e) {
+                    for (int i = b; i < e; ++i)
+                        fun(i);
+                });
+                pool.wait();
+                pool.parallel_for_each(indices, fun);
+                pool.wait();
+            }
+            if (allocations != before)
+                throw std::runtime_error("parallel_for allocates");
+            if (std::count(x.begin(), x.end(), 61) != 1000)
+                throw std::runtime_error(
+                  "parallel_for without allocations gives wrong result");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_reduce()
+        {
+            // std::cout << "      * parallel_reduce: ";
+            auto plus = [](int64_t a, int64_t b) { return a + b; };
+            auto id = [](int i) { return int64_t(i); };
+            const int64_t expected = int64_t(9999) * 10000 / 2;
+            if (parallel_reduce(0, 10000, int64_t(0), id, plus) != expected)
+                throw std::runtime_error(
+                  "static parallel_reduce gives wrong result");
+
+            ThreadPool pool;
+            if (pool.parallel_reduce(0, 10000, int64_t(0), id, plus, 1) !=
+                expected)
+                throw std::runtime_error("parallel_reduce gives wrong result");
+            if (pool.parallel_reduce(5, 5, int64_t(7), id, plus) != 7)
+                throw std::runtime_error(
+                  "empty parallel_reduce doesn't return identity");
+
+            auto max_value = pool.parallel_reduce(
+              size_t(0),
+              size_t(1000),
+              size_t(0),
+              [](size_t i) { return (i * 7919) % 1000; },
+              [](size_t a, size_t b) { return std::max(a, b); });
+            if (max_value != 999)
+                throw std::runtime_error(
+                  "parallel_reduce with max gives wrong result");
+
+            // nested calls from worker threads
+            std::vector<int64_t> sums(10);
+            pool.parallel_for(0, 10, [&](int i) {
+                sums[static_cast<size_t>(i)] =
+                  pool.parallel_reduce(0, 100 * i, int64_t(0), id, plus);
+            });
+            for (int i = 0; i < 10; ++i) {
+                if (sums[static_cast<size_t>(i)] !=
+                    int64_t(100 * i - 1) * 100 * i / 2)
+                    throw std::runtime_error(
+                      "nested parallel_reduce gives wrong result");
+            }
+
+            ThreadPool serial_pool(0);
+            if (serial_pool.parallel_reduce(0, 10000, int64_t(0), id, plus) !=
+                expected)
+                throw std::runtime_error(
+                  "single threaded parallel_reduce gives wrong result");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_inclusive_scan(), parallel_exclusive_scan()
+        {
+            // std::cout << "      * parallel scans: ";
+            std::vector<int64_t> x(10007);
+            for (size_t i = 0; i < x.size(); ++i)
+                x[i] = static_cast<int64_t>(i % 13) - 4;
+            std::vector<int64_t> inclusive(x.size()), exclusive(x.size());
+            std::partial_sum(x.begin(), x.end(), inclusive.begin());
+            exclusive[0] = 5;
+            for (size_t i = 1; i < x.size(); ++i)
+                exclusive[i] = exclusive[i - 1] + x[i - 1];
+
+            ThreadPool pool;
+            std::vector<int64_t> y(x.size());
+            auto y_end =
+              pool.parallel_inclusive_scan(x.begin(), x.end(), y.begin());
+            if (y != inclusive || y_end != y.end())
+                throw std::runtime_error(
+                  "parallel_inclusive_scan gives wrong result");
+            parallel_exclusive_scan(x.begin(), x.end(), y.begin(), int64_t(5));
+            if (y != exclusive)
+                throw std::runtime_error(
+                  "parallel_exclusive_scan gives wrong result");
+
+            // in place
+            y = x;
+            parallel_inclusive_scan(y.begin(), y.end(), y.begin());
+            if (y != inclusive)
+                throw std::runtime_error(
+                  "in-place parallel_inclusive_scan gives wrong result");
+            y = x;
+            pool.parallel_exclusive_scan(
+              y.begin(), y.end(), y.begin(), int64_t(5));
+            if (y != exclusive)
+                throw std::runtime_error(
+                  "in-place parallel_exclusive_scan gives wrong result");
+
+            // non-commutative operation
+            std::vector<std::string> words(100);
+            for (size_t i = 0; i < words.size(); ++i)
+                words[i] = std::string(1, static_cast<char>('a' + i % 26));
+            std::vector<std::string> expected_words(words.size());
+            std::partial_sum(
+              words.begin(), words.end(), expected_words.begin());
+            std::vector<std::string> scanned_words(words.size());
+            pool.parallel_inclusive_scan(
+              words.begin(),
+              words.end(),
+              scanned_words.begin(),
+              [](const std::string& a, const std::string& b) { return a + b; });
+            if (scanned_words != expected_words)
+                throw std::runtime_error(
+                  "parallel_inclusive_scan changes order of operations");
+            pool.parallel_exclusive_scan(words.begin(),
+                                         words.end(),
+                                         scanned_words.begin(),
+                                         std::string(),
+                                         [](const std::string& a,
+                                            const std::string& b) {
+                                             return a + b;
+                                         });
+            if (scanned_words[0] != "" ||
+                scanned_words.back() != expected_words[words.size() - 2])
+                throw std::runtime_error(
+                  "parallel_exclusive_scan changes order of operations");
+
+            ThreadPool serial_pool(0);
+            serial_pool.parallel_inclusive_scan(x.begin(), x.end(), y.begin());
+            if (y != inclusive)
+                throw std::runtime_error(
+                  "single threaded parallel_inclusive_scan gives wrong result");
+            std::vector<int64_t> empty;
+            if (pool.parallel_exclusive_scan(
+                  empty.begin(), empty.end(), y.begin(), int64_t(0)) !=
+                y.begin())
+                throw std::runtime_error("empty parallel scan writes output");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_for() with AffinityPartitioner
+        {
+            // std::cout << "      * parallel_for with affinity: ";
+            std::vector<size_t> x(10000, 0);
+            AffinityPartitioner partitioner;
+            ThreadPool pool(3);
+            for (int rep = 0; rep < 5; ++rep) {
+                pool.parallel_for(
+                  size_t(0), x.size(), [&](size_t i) { x[i]++; }, partitioner);
+            }
+            // different range and pool reset the recorded workers
+            pool.parallel_for_range(
+              size_t(0),
+              size_t(2),
+              [&](size_t b, size_t e) {
+                  for (auto i = b; i < e; ++i)
+                      x[i]++;
+              },
+              partitioner);
+            AffinityPartitioner chunked(64);
+            for (int rep = 0; rep < 2; ++rep) {
+                parallel_for(
+                  size_t(0), x.size(), [&](size_t i) { x[i]++; }, chunked);
+            }
+            if (x[0] != 8 || x[1] != 8 ||
+                std::count(x.begin() + 2, x.end(), 7) != 9998)
+                throw std::runtime_error(
+                  "parallel_for with affinity gives wrong result");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_for_2d(), parallel_for_3d()
+        {
+            // std::cout << "      * tiled parallel_for: ";
+            const size_t rows = 37, cols = 53, tile = 8;
+            std::vector<int> x(rows * cols, 0);
+            std::atomic_bool tiles_ok{ true };
+            auto visit_2d = [&](size_t rb, size_t re, size_t cb, size_t ce) {
+                if (re - rb > tile || ce - cb > tile || rb % tile || cb % tile)
+                    tiles_ok = false;
+                for (auto i = rb; i < re; ++i)
+                    for (auto j = cb; j < ce; ++j)
+                        x[i * cols + j]++;
+            };
+            for (size_t threads = 0; threads < 5; ++threads) {
+                ThreadPool pool(threads);
+                pool.parallel_for_2d(rows, cols, tile, visit_2d);
+            }
+            parallel_for_2d(rows, cols, tile, visit_2d);
+            if (!tiles_ok || std::count(x.begin(), x.end(), 6) != 37 * 53)
+                throw std::runtime_error(
+                  "parallel_for_2d gives wrong result");
+
+            std::vector<int> y(9 * 10 * 11, 0);
+            parallel_for_3d(
+              9,
+              10,
+              11,
+              4,
+              [&](size_t b0, size_t e0, size_t b1, size_t e1, size_t b2,
+                  size_t e2) {
+                  for (auto i = b0; i < e0; ++i)
+                      for (auto j = b1; j < e1; ++j)
+                          for (auto k = b2; k < e2; ++k)
+                              y[(i * 10 + j) * 11 + k]++;
+              });
+            if (std::count(y.begin(), y.end(), 1) != 9 * 10 * 11)
+                throw std::runtime_error(
+                  "parallel_for_3d gives wrong result");
+
+            // tiles follow a Morton curve
+            loop::Tiles<2> tiles({ { 4, 4 } }, 2);
+            const size_t morton_rows[] = { 0, 0, 2, 2 };
+            const size_t morton_cols[] = { 0, 2, 0, 2 };
+            std::array<size_t, 2> pos;
+            for (size_t t = 0; t < tiles.count(); ++t) {
+                if (!tiles.locate(t, pos) ||
+                    tiles.begin(pos, 0) != morton_rows[t] ||
+                    tiles.begin(pos, 1) != morton_cols[t])
+                    throw std::runtime_error("tiles are not in Morton order");
+            }
+
+            // uneven grids skip tile numbers outside the space
+            loop::Tiles<2> wide({ { 1, 5 } }, 1);
+            size_t inside = 0;
+            for (size_t t = 0; t < wide.count(); ++t) {
+                if (wide.locate(t, pos)) {
+                    if (pos[0] != 0 || pos[1] != inside)
+                        throw std::runtime_error(
+                          "tiles of uneven grid are out of order");
+                    ++inside;
+                }
+            }
+            if (wide.count() != 8 || inside != 5)
+                throw std::runtime_error("uneven grid has wrong tiles");
+            ThreadPool pool;
+            pool.parallel_for_2d(0, cols, tile, visit_2d);
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_sort()
+        {
+            // std::cout << "      * parallel_sort: ";
+            std::vector<int> x(20001);
+            for (size_t i = 0; i < x.size(); ++i)
+                x[i] = static_cast<int>((i * 7919) % 1000);
+            auto expected = x;
+            std::sort(expected.begin(), expected.end());
+
+            for (size_t threads = 0; threads < 5; ++threads) {
+                ThreadPool pool(threads);
+                auto y = x;
+                pool.parallel_sort(y.begin(), y.end());
+                if (y != expected)
+                    throw std::runtime_error(
+                      "parallel_sort gives wrong result");
+            }
+
+            auto y = x;
+            parallel_sort(y.begin(), y.end(), std::greater<int>());
+            if (!std::equal(y.begin(), y.end(), expected.rbegin()))
+                throw std::runtime_error(
+                  "static parallel_sort gives wrong result");
+
+            ThreadPool pool(3);
+            pool.parallel_sort(y.begin(), y.end());
+            if (y != expected)
+                throw std::runtime_error(
+                  "parallel_sort of reversed range gives wrong result");
+
+            std::vector<std::unique_ptr<int>> ptrs(20000);
+            for (size_t i = 0; i < ptrs.size(); ++i)
+                ptrs[i].reset(new int(x[i]));
+            pool.parallel_sort(
+              ptrs.begin(),
+              ptrs.end(),
+              [](const std::unique_ptr<int>& a, const std::unique_ptr<int>& b) {
+                  return *a < *b;
+              });
+            for (size_t i = 1; i < ptrs.size(); ++i) {
+                if (!ptrs[i] || *ptrs[i - 1] > *ptrs[i])
+                    throw std::runtime_error(
+                      "parallel_sort of move-only type gives wrong result");
+            }
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_copy_if(), parallel_remove_if(), parallel_partition()
+        {
+            // std::cout << "      * parallel filters: ";
+            std::vector<int> x(10001);
+            std::iota(x.begin(), x.end(), 0);
+            auto is_odd = [](int i) { return i % 2 == 1; };
+            auto is_even = [](int i) { return i % 2 == 0; };
+            std::vector<int> odd, even;
+            std::copy_if(x.begin(), x.end(), std::back_inserter(odd), is_odd);
+            std::copy_if(x.begin(), x.end(), std::back_inserter(even), is_even);
+
+            for (size_t threads = 0; threads < 5; ++threads) {
+                ThreadPool pool(threads);
+                std::vector<int> y(x.size(), -1);
+                auto y_end =
+                  pool.parallel_copy_if(x.begin(), x.end(), y.begin(), is_odd);
+                if (!std::equal(odd.begin(), odd.end(), y.begin()) ||
+                    y_end != y.begin() + static_cast<long>(odd.size()) ||
+                    *y_end != -1)
+                    throw std::runtime_error(
+                      "parallel_copy_if gives wrong result");
+
+                y = x;
+                y_end = pool.parallel_remove_if(y.begin(), y.end(), is_odd);
+                if (y_end != y.begin() + static_cast<long>(even.size()) ||
+                    !std::equal(even.begin(), even.end(), y.begin()))
+                    throw std::runtime_error(
+                      "parallel_remove_if gives wrong result");
+
+                y = x;
+                y_end = pool.parallel_partition(y.begin(), y.end(), is_odd);
+                if (y_end != y.begin() + static_cast<long>(odd.size()) ||
+                    !std::equal(odd.begin(), odd.end(), y.begin()) ||
+                    !std::equal(even.begin(), even.end(), y_end))
+                    throw std::runtime_error(
+                      "parallel_partition gives wrong result");
+            }
+
+            std::vector<int> y(x.size());
+            auto y_end = parallel_copy_if(
+              x.begin(), x.end(), y.begin(), [](int) { return false; });
+            if (y_end != y.begin())
+                throw std::runtime_error(
+                  "static parallel_copy_if gives wrong result");
+            y = x;
+            if (parallel_remove_if(y.begin(), y.end(), is_even) -
+                  y.begin() !=
+                static_cast<long>(odd.size()))
+                throw std::runtime_error(
+                  "static parallel_remove_if gives wrong result");
+            y = x;
+            if (parallel_partition(y.begin(), y.end(), is_even) -
+                  y.begin() !=
+                static_cast<long>(even.size()))
+                throw std::runtime_error(
+                  "static parallel_partition gives wrong result");
+
+            std::vector<std::unique_ptr<int>> ptrs(1000);
+            for (size_t i = 0; i < ptrs.size(); ++i)
+                ptrs[i].reset(new int(static_cast<int>(i)));
+            ThreadPool pool(3);
+            auto ptrs_end = pool.parallel_remove_if(
+              ptrs.begin(), ptrs.end(), [](const std::unique_ptr<int>& p) {
+                  return *p % 3 != 0;
+              });
+            if (ptrs_end - ptrs.begin() != 334)
+                throw std::runtime_error(
+                  "parallel_remove_if of move-only type gives wrong result");
+            for (auto it = ptrs.begin(); it != ptrs_end; ++it) {
+                if (!*it || **it != 3 * (it - ptrs.begin()))
+                    throw std::runtime_error(
+                      "parallel_remove_if of move-only type gives wrong "
+                      "result");
+            }
+            // std::cout << "OK" << std::endl;
+        }
+
+        // TaskGroup
+        {
+            // std::cout << "      * task groups: ";
+            ThreadPool pool(1);
+            std::atomic_bool started{ false }, release{ false };
+            std::atomic_int count{ 0 };
+
+            // A group only waits for its own tasks.
+            TaskGroup slow(pool), fast(pool);
+            slow.push([&] {
+                started = true;
+                while (!release)
+                    std::this_thread::yield();
+            });
+            while (!started)
+                std::this_thread::yield();
+            for (int i = 0; i < 100; ++i)
+                fast.push([&](int k) { count += k; }, 1);
+            std::thread([&] { fast.wait(); }).join();
+            if (count != 100 || release)
+                throw std::runtime_error("TaskGroup::wait() doesn't wait");
+
+            // Cancelling drops the pending tasks of a group only.
+            started = false;
+            slow.push([&] { started = true; });
+            fast.push([&] { count++; });
+            slow.cancel();
+            release = true;
+            slow.wait();
+            fast.wait();
+            if (started || count != 101)
+                throw std::runtime_error("TaskGroup::cancel() fails");
+
+            // A group is usable again after wait().
+            slow.push([&] { started = true; });
+            slow.wait();
+            if (!started)
+                throw std::runtime_error("cancelled TaskGroup isn't reusable");
+
+            TaskGroup group(pool);
+            group.push([] { throw std::runtime_error("test error"); });
+            try {
+                group.wait();
+                throw std::runtime_error("TaskGroup doesn't rethrow exception");
+            } catch (const std::exception& e) {
+                if (std::string(e.what()) != "test error")
+                    throw;
+            }
+            group.push([&] { count++; });
+            group.wait();
+            if (count != 102)
+                throw std::runtime_error(
+                  "pool unusable after TaskGroup exception");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // TaskGraph
+        {
+            // std::cout << "      * task graphs: ";
+            // Layers of nodes where each node depends on all nodes of the
+            // previous layer. When a node runs, the previous layer has
+            // finished one more run than its own layer.
+            const size_t layers = 5, width = 8;
+            std::vector<std::atomic_size_t> finished(layers);
+            std::atomic_bool ordered{ true };
+            auto build = [&](TaskGraph& graph) {
+                for (size_t l = 0; l < layers; ++l) {
+                    for (size_t i = 0; i < width; ++i) {
+                        graph.add([&, l] {
+                            const size_t runs = finished[l] / width + 1;
+                            if (l > 0 && finished[l - 1] != runs * width)
+                                ordered = false;
+                            finished[l]++;
+                        });
+                        for (size_t j = 0; l > 0 && j < width; ++j)
+                            graph.precede((l - 1) * width + j,
+                                          l * width + i);
+                    }
+                }
+            };
+            auto check = [&](size_t runs) {
+                for (auto& f : finished) {
+                    if (f != runs * width)
+                        throw std::runtime_error("TaskGraph misses nodes");
+                    f = 0;
+                }
+                if (!ordered)
+                    throw std::runtime_error(
+                      "TaskGraph ignores dependencies");
+            };
+
+            ThreadPool pool(4);
+            TaskGraph graph(pool);
+            build(graph);
+            for (int rep = 0; rep < 10; ++rep)
+                graph.run();
+            check(10);
+
+            // Reruns don't allocate. With a single worker, this thread
+            // pushes nodes to a queue and the worker to its own deque. While
+            // the worker is busy, both get as many task nodes as the graph
+            // has nodes, which is all any later run needs.
+            ThreadPool single(1);
+            TaskGraph reused(single);
+            build(reused);
+            reused.run();
+            std::atomic_bool busy{ false }, release{ false };
+            single.push([&] {
+                for (size_t i = 0; i < layers * width; ++i)
+                    single.push([] {});
+                busy = true;
+                while (!release)
+                    std::this_thread::yield();
+            });
+            while (!busy)
+                std::this_thread::yield();
+            for (size_t i = 0; i < layers * width; ++i)
+                single.push([] {});
+            release = true;
+            single.wait();
+            check(1);
+            const size_t before = allocations;
+            for (int rep = 0; rep < 20; ++rep)
+                reused.run();
+            if (allocations != before)
+                throw std::runtime_error("TaskGraph::run() allocates");
+            check(20);
+
+            TaskGraph cyclic(pool);
+            cyclic.add([] {});
+            cyclic.add([] {});
+            cyclic.precede(0, 1);
+            cyclic.precede(1, 0);
+            try {
+                cyclic.run();
+                throw std::runtime_error("TaskGraph runs cycles");
+            } catch (const std::invalid_argument&) {
+            }
+
+            // Nodes after a failed node are skipped.
+            TaskGraph failing(pool);
+            std::atomic_int count{ 0 };
+            failing.add([] { throw std::runtime_error("test error"); });
+            failing.add([&] { count++; });
+            failing.precede(0, 1);
+            try {
+                failing.run();
+                throw std::runtime_error("TaskGraph doesn't rethrow exception");
+            } catch (const std::exception& e) {
+                if (std::string(e.what()) != "test error")
+                    throw;
+            }
+            if (count != 0)
+                throw std::runtime_error("TaskGraph runs nodes after error");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // Future
+        {
+            // std::cout << "      * futures: ";
+            ThreadPool pool(2);
+            auto twice = [](int x) { return 2 * x; };
+            if (pool.submit(twice, 21).get() != 42)
+                throw std::runtime_error("submit() gives wrong result");
+
+            std::atomic_int count{ 0 };
+            auto chained = pool.submit([] { return 1; })
+                             .then([](int x) { return x + 1; })
+                             .then([&](int x) { count += x; })
+                             .then([&] { return count * 10; });
+            if (chained.get() != 20 || chained.valid())
+                throw std::runtime_error("Future::then() gives wrong result");
+
+            // Continuations of failed computations are skipped.
+            auto failed = pool.submit([]() -> int {
+                                  throw std::runtime_error("test error");
+                              })
+                            .then([&](int) { count++; });
+            try {
+                failed.get();
+                throw std::runtime_error("Future doesn't rethrow exception");
+            } catch (const std::exception& e) {
+                if (std::string(e.what()) != "test error")
+                    throw;
+            }
+            if (count != 2)
+                throw std::runtime_error("Future::then() runs after error");
+
+            std::vector<Future<int>> futures;
+            for (int i = 0; i < 100; ++i)
+                futures.push_back(pool.submit(twice, i));
+            auto sum = when_all(std::move(futures))
+                         .then([](std::vector<Future<int>> ready) {
+                             int s = 0;
+                             for (auto& f : ready)
+                                 s += f.get();
+                             return s;
+                         });
+            if (sum.get() != 9900)
+                throw std::runtime_error("when_all() gives wrong result");
+
+            // The slow task must have started; otherwise, the thread waiting
+            // for when_any() could run it itself.
+            std::atomic_bool started{ false }, release{ false };
+            std::vector<Future<int>> racing;
+            racing.push_back(pool.submit([&] {
+                started = true;
+                while (!release)
+                    std::this_thread::yield();
+                return 0;
+            }));
+            while (!started)
+                std::this_thread::yield();
+            racing.push_back(pool.submit([] { return 1; }));
+            auto any = when_any(std::move(racing)).get();
+            release = true;
+            if (any.index != 1 || any.futures[1].get() != 1)
+                throw std::runtime_error("when_any() gives wrong result");
+            any.futures[0].wait();
+
+            // Waiting inside a task runs other tasks in the meantime.
+            ThreadPool single(1);
+            auto nested = single.submit([&] {
+                return single.submit(twice, 1).get();
+            });
+            if (nested.get() != 2)
+                throw std::runtime_error("nested Future::get() fails");
+
+            // The task and its result share one allocation.
+            single.submit(twice, 1).get();
+            const size_t before = allocations;
+            auto one = single.submit(twice, 1);
+            one.get();
+            if (allocations != before + 1)
+                throw std::runtime_error("submit() allocates more than once");
+            // std::cout << "OK" << std::endl;
+        }
+
+#if __cplusplus >= 201703L && defined(__cpp_impl_coroutine)
+        // coroutines
+        {
+            // std::cout << "      * coroutines: ";
+            ThreadPool pool(2);
+            if (coro_sum(pool, 10).get() != 1295)
+                throw std::runtime_error("coroutine gives wrong result");
+            if (coro_thread(pool).get() == std::this_thread::get_id())
+                throw std::runtime_error("schedule() doesn't switch thread");
+
+            std::vector<Task<int>> tasks;
+            for (int i = 0; i < 50; ++i)
+                tasks.push_back(coro_sum(pool, i % 5));
+            for (auto& task : tasks) {
+                if (task.get() < 1010)
+                    throw std::runtime_error("coroutine gives wrong result");
+            }
+
+            try {
+                coro_throw(pool).get();
+                throw std::runtime_error("coroutine doesn't rethrow");
+            } catch (const std::exception& e) {
+                if (std::string(e.what()) != "test error")
+                    throw;
+            }
+
+            // All coroutines awaiting a group are resumed.
+            {
+                TaskGroup group(pool);
+                std::atomic_bool release{ false };
+                std::atomic_int arrived{ 0 };
+                group.push([&] {
+                    while (!release)
+                        std::this_thread::yield();
+                });
+                std::vector<std::thread> awaiting;
+                for (int i = 0; i < 2; ++i) {
+                    awaiting.emplace_back([&] {
+                        coro_await_group(pool, group, arrived).get();
+                    });
+                }
+                while (arrived < 2)
+                    std::this_thread::yield();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                release = true;
+                for (auto& thread : awaiting)
+                    thread.join();
+            }
+
+            // get() on a worker runs the resumption queued behind it.
+            ThreadPool single(1);
+            int square = 0;
+            single.push([&] { square = coro_square(single, 7).get(); });
+            single.wait();
+            if (square != 49)
+                throw std::runtime_error("get() on a worker gives wrong result");
+
+            // Without active threads, coroutines run inline.
+            pool.set_active_threads(0);
+            if (coro_sum(pool, 3).get() != 1015)
+                throw std::runtime_error("inline coroutine gives wrong result");
+            // std::cout << "OK" << std::endl;
+        }
+#endif
+
+        // AdaptivePartitioner
+        {
+            // std::cout << "      * adaptive partitioner: ";
+            ThreadPool pool(3);
+            const auto caller = std::this_thread::get_id();
+
+            // Cheap loops are run by the calling thread alone.
+            std::vector<int> x(10, 0);
+            AdaptivePartitioner cheap;
+            bool serial = false;
+            for (int rep = 0; rep < 10 && !serial; ++rep) {
+                std::atomic_bool foreign{ false };
+                pool.parallel_for(
+                  0,
+                  10,
+                  [&](int i) {
+                      x[static_cast<size_t>(i)]++;
+                      if (std::this_thread::get_id() != caller)
+                          foreign = true;
+                  },
+                  cheap);
+                serial = !foreign;
+            }
+            if (!serial)
+                throw std::runtime_error(
+                  "cheap adaptive parallel_for() doesn't run serially");
+
+            // The serial part respects an explicit grain size.
+            std::vector<int> y(1000, 0);
+            std::atomic_int bad_chunks{ 0 };
+            AdaptivePartitioner grained(3);
+            pool.parallel_for_range(
+              0,
+              1000,
+              [&](int b, int e) {
+                  if (b >= e || e - b > 3)
+                      bad_chunks++;
+                  for (auto i = b; i < e; ++i)
+                      y[static_cast<size_t>(i)]++;
+              },
+              grained);
+            if (bad_chunks > 0)
+                throw std::runtime_error(
+                  "serial part of parallel_for_range exceeds grain size");
+            if (std::count(y.begin(), y.end(), 1) != 1000)
+                throw std::runtime_error(
+                  "serial part of parallel_for_range gives wrong result");
+
+            // Expensive loops still wake the workers.
+            std::mutex mtx;
+            std::vector<std::thread::id> ids;
+            AdaptivePartitioner expensive;
+            pool.parallel_for(
+              0,
+              20,
+              [&](int) {
+                  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                  std::lock_guard<std::mutex> lk(mtx);
+                  if (std::find(ids.begin(), ids.end(),
+                                std::this_thread::get_id()) == ids.end())
+                      ids.push_back(std::this_thread::get_id());
+              },
+              expensive);
+            if (ids.size() < 2)
+                throw std::runtime_error(
+                  "expensive adaptive parallel_for() runs serially");
+
+            // The global pool accepts a partitioner, too.
+            std::vector<int> z(100, 0);
+            parallel_for(
+              0, 100, [&](int i) { z[static_cast<size_t>(i)]++; }, cheap);
+            if (std::count(z.begin(), z.end(), 1) != 100)
+                throw std::runtime_error(
+                  "adaptive parallel_for() gives wrong result");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_find_if(), parallel_any_of(), parallel_all_of()
+        {
+            // std::cout << "      * parallel search: ";
+            std::vector<int> x(100000);
+            std::iota(x.begin(), x.end(), 0);
+            auto is_large = [](int i) { return i >= 70000; };
+            auto is_multiple = [](int i) { return i > 0 && i % 9973 == 0; };
+
+            for (size_t threads = 0; threads < 5; ++threads) {
+                ThreadPool pool(threads);
+                if (pool.parallel_find_if(x.begin(), x.end(), is_large) !=
+                      x.begin() + 70000 ||
+                    pool.parallel_find_if(x.begin(), x.end(), is_multiple) !=
+                      x.begin() + 9973)
+                    throw std::runtime_error(
+                      "parallel_find_if doesn't find the first match");
+                if (pool.parallel_find_if(x.begin(), x.end(), [](int i) {
+                        return i < 0;
+                    }) != x.end() ||
+                    pool.parallel_find_if(x.end(), x.end(), is_large) !=
+                      x.end())
+                    throw std::runtime_error(
+                      "parallel_find_if finds non-existing match");
+
+                if (!pool.parallel_any_of(x.begin(), x.end(), is_multiple) ||
+                    pool.parallel_any_of(x.begin(), x.end(), [](int i) {
+                        return i < 0;
+                    }) ||
+                    pool.parallel_any_of(x.end(), x.end(), is_large))
+                    throw std::runtime_error(
+                      "parallel_any_of gives wrong result");
+                if (!pool.parallel_all_of(x.begin(), x.end(), [](int i) {
+                        return i >= 0;
+                    }) ||
+                    pool.parallel_all_of(x.begin(), x.end(), is_large) ||
+                    !pool.parallel_all_of(x.end(), x.end(), is_large))
+                    throw std::runtime_error(
+                      "parallel_all_of gives wrong result");
+
+                // A match at the front cancels the rest of the search.
+                std::atomic_size_t calls{ 0 };
+                auto count_calls = [&](int) {
+                    calls++;
+                    return true;
+                };
+                pool.parallel_find_if(x.begin(), x.end(), count_calls);
+                pool.parallel_any_of(x.begin(), x.end(), count_calls);
+                if (calls > x.size() / 2)
+                    throw std::runtime_error(
+                      "parallel search isn't cancelled after a match");
+
+                try {
+                    pool.parallel_any_of(x.begin(), x.end(), [](int i) {
+                        if (i == 5000)
+                            throw std::runtime_error("test error");
+                        return false;
+                    });
+                    throw std::runtime_error(
+                      "parallel_any_of doesn't rethrow exception");
+                } catch (const std::exception& e) {
+                    if (std::string(e.what()) != "test error")
+                        throw;
+                }
+            }
+
+            if (parallel_find_if(x.begin(), x.end(), is_multiple) !=
+                  x.begin() + 9973 ||
+                !parallel_any_of(x.begin(), x.end(), is_large) ||
+                parallel_all_of(x.begin(), x.end(), is_large))
+                throw std::runtime_error(
+                  "static parallel search gives wrong result");
+            // std::cout << "OK" << std::endl;
+        }
+
         // nested parallel_for()
         {
             // std::cout << "      * nested parallel_for: ";
@@ -294,6 +1617,119 @@ main()
                 throw std::runtime_error(
                   "nested parallel_for gives wrong result");
             }
+
+            // inner loops have finished when they return
+            std::atomic_int unfinished{ 0 };
+            pool.parallel_for(0, 20, [&](int) {
+                std::vector<int> y(1000, 0);
+                pool.parallel_for(0, 1000, [&](int j) {
+                    y[static_cast<size_t>(j)] = 1;
+                });
+                unfinished += 1000 - std::accumulate(y.begin(), y.end(), 0);
+            });
+            if (unfinished != 0)
+                throw std::runtime_error("nested parallel_for doesn't wait");
+
+            // recursive fork-join
+            std::function<int64_t(int64_t)> fib = [&](int64_t n) {
+                if (n < 2)
+                    return n;
+                std::vector<int64_t> r(2);
+                pool.parallel_for(0, 2, [&](int k) {
+                    r[static_cast<size_t>(k)] = fib(n - 1 - k);
+                });
+                return r[0] + r[1];
+            };
+            if (fib(12) != 144)
+                throw std::runtime_error("recursive parallel_for fails");
+
+            // exceptions in loop bodies are rethrown by the loop
+            std::exception_ptr eptr = nullptr;
+            try {
+                pool.parallel_for(0, 100, [&](int i) {
+                    pool.parallel_for(0, 100, [&](int j) {
+                        if (i == 50 && j == 50)
+                            throw std::runtime_error("test error");
+                    });
+                });
+            } catch (...) {
+                eptr = std::current_exception();
+            }
+            if (!eptr)
+                throw std::runtime_error(
+                  "exception in nested loop not rethrown");
+            std::atomic_int after_error{ 0 };
+            pool.parallel_for(0, 100, [&](int) { after_error++; });
+            if (after_error != 100)
+                throw std::runtime_error("pool unusable after loop exception");
+            // std::cout << "OK" << std::endl;
+        }
+
+        // parallel_invoke(), ForkJoin
+        {
+            // std::cout << "      * fork-join: ";
+            for (size_t threads = 0; threads < 4; ++threads) {
+                ThreadPool pool(threads);
+                int a = 0, b = 0, c = 0;
+                pool.parallel_invoke([&] { a = 1; }, [&] { b = 2; }, [&] {
+                    c = 3;
+                });
+                if (a + b + c != 6)
+                    throw std::runtime_error("parallel_invoke doesn't wait");
+
+                std::function<int64_t(int64_t)> fib = [&](int64_t n) {
+                    if (n < 2)
+                        return n;
+                    int64_t x, y;
+                    pool.parallel_invoke([&] { x = fib(n - 1); },
+                                         [&] { y = fib(n - 2); });
+                    return x + y;
+                };
+                if (fib(12) != 144)
+                    throw std::runtime_error("recursive parallel_invoke fails");
+
+                // spawn from several threads; sync only waits for own tasks
+                std::vector<std::thread> callers;
+                std::atomic_int wrong{ 0 };
+                for (int t = 0; t < 3; ++t) {
+                    callers.emplace_back([&] {
+                        std::atomic_int sum{ 0 };
+                        ForkJoin scope(pool);
+                        for (int i = 0; i < 100; ++i)
+                            scope.spawn([&sum, i] { sum += i; });
+                        scope.sync();
+                        if (sum != 4950)
+                            wrong++;
+                    });
+                }
+                for (auto& caller : callers)
+                    caller.join();
+                if (wrong != 0)
+                    throw std::runtime_error("ForkJoin::sync() doesn't wait");
+
+                try {
+                    pool.parallel_invoke(
+                      [] {}, [] { throw std::runtime_error("test error"); });
+                    throw std::runtime_error(
+                      "parallel_invoke doesn't rethrow exception");
+                } catch (const std::exception& e) {
+                    if (std::string(e.what()) != "test error")
+                        throw;
+                }
+                std::atomic_int after_error{ 0 };
+                ForkJoin scope(pool);
+                scope.spawn([&] { after_error++; });
+                scope.sync();
+                if (after_error != 1)
+                    throw std::runtime_error(
+                      "pool unusable after fork-join exception");
+            }
+
+            int a = 0, b = 0;
+            parallel_invoke([&] { a = 1; }, [&] { b = 1; });
+            if (a + b != 2)
+                throw std::runtime_error(
+                  "static parallel_invoke gives wrong result");
             // std::cout << "OK" << std::endl;
         }
 
@@ -342,6 +1778,44 @@ main()
             if (count_wrong > 0)
                 throw std::runtime_error(
                   "parallel_for_each list gives wrong result");
+
+            std::forward_list<size_t> z(10000, 1);
+            pool.parallel_for_each(z, fun);
+            count_wrong = 0;
+            for (auto zz : z)
+                count_wrong += (zz != 2);
+            std::forward_list<size_t> one(1, 1);
+            pool.parallel_for_each(one, fun);
+            count_wrong += (one.front() != 2);
+            if (count_wrong > 0)
+                throw std::runtime_error(
+                  "parallel_for_each forward_list gives wrong result");
+
+            std::map<int, size_t> m;
+            for (int i = 0; i < 1000; i++)
+                m[i] = 1;
+            pool.parallel_for_each(m, [](std::pair<const int, size_t>& kv) {
+                kv.second = static_cast<size_t>(kv.first);
+            });
+            count_wrong = 0;
+            for (const auto& kv : m)
+                count_wrong += (kv.second != static_cast<size_t>(kv.first));
+            if (count_wrong > 0)
+                throw std::runtime_error(
+                  "parallel_for_each map gives wrong result");
+
+            std::exception_ptr eptr = nullptr;
+            try {
+                pool.parallel_for_each(y, [](size_t& yy) {
+                    if (yy == 4)
+                        throw std::runtime_error("test error");
+                });
+            } catch (...) {
+                eptr = std::current_exception();
+            }
+            if (!eptr)
+                throw std::runtime_error(
+                  "exception in parallel_for_each list not rethrown");
             // std::cout << "OK" << std::endl;
         }
 
@@ -418,6 +1892,25 @@ main()
                   "single threaded parallel_for gives wrong result");
             }
 
+            pool.parallel_for_range(
+              0, checked_size_int(x.size()), [&](int b, int e) {
+                  for (auto i = b; i < e; ++i)
+                      x[static_cast<size_t>(i)] += 1;
+              });
+            pool.parallel_for_range(0, 0, [&](int, int) {
+                throw std::runtime_error("empty range is processed");
+            });
+            pool.parallel_for(0, checked_size_int(x.size()), [&](int i) {
+                x[static_cast<size_t>(i)] -= 1;
+            }, 10);
+            count_wrong = 0;
+            for (size_t i = 0; i < x.size(); i++)
+                count_wrong += (x[i] != 3);
+            if (count_wrong > 0) {
+                throw std::runtime_error(
+                  "single threaded parallel_for_range gives wrong result");
+            }
+
             pool.parallel_for_each(x, [](size_t& xx) { xx += 1; });
             count_wrong = 0;
             for (size_t i = 0; i < x.size(); i++)
@@ -468,6 +1961,82 @@ main()
             // std::cout << "OK" << std::endl;
         }
 
+        // tasks of groups etc. run after an unrelated task has failed
+        {
+            ThreadPool pool(2);
+            pool.push([] { throw std::runtime_error("test error"); });
+            while (!pool.done()) {
+                std::this_thread::yield();
+            }
+
+            // Other threads never see the pool's error.
+            std::atomic_int count{ 0 };
+            std::thread other([&] {
+                TaskGroup group(pool);
+                for (int i = 0; i < 10; i++) {
+                    group.push([&] { count++; });
+                }
+                group.wait();
+            });
+            other.join();
+            if (count != 10) {
+                throw std::runtime_error(
+                  "task group drops tasks after an error");
+            }
+
+            int answer = 0;
+            std::thread getter([&] {
+                auto future = pool.submit([] { return 6; });
+                answer = future.then([](int x) { return 7 * x; }).get();
+            });
+            getter.join();
+            if (answer != 42) {
+                throw std::runtime_error("future drops tasks after an error");
+            }
+
+            std::atomic_int invoked{ 0 };
+            std::thread invoker([&] {
+                pool.parallel_invoke([&] { invoked++; },
+                                     [&] { invoked++; },
+                                     [&] { invoked++; });
+            });
+            invoker.join();
+            if (invoked != 3) {
+                throw std::runtime_error(
+                  "parallel_invoke drops tasks after an error");
+            }
+
+            // a diamond with two sources, so both spawn() paths are taken
+            std::atomic_int nodes{ 0 };
+            TaskGraph graph(pool);
+            auto a = graph.add([&] { nodes++; });
+            auto b = graph.add([&] { nodes++; });
+            auto c = graph.add([&] { nodes++; });
+            auto d = graph.add([&] { nodes++; });
+            auto e = graph.add([&] { nodes++; });
+            graph.precede(a, c);
+            graph.precede(a, d);
+            graph.precede(b, e);
+            graph.precede(c, e);
+            graph.precede(d, e);
+            std::thread runner([&] { graph.run(); });
+            runner.join();
+            if (nodes != 5) {
+                throw std::runtime_error(
+                  "task graph drops tasks after an error");
+            }
+
+            std::exception_ptr eptr = nullptr;
+            try {
+                pool.wait();
+            } catch (...) {
+                eptr = std::current_exception();
+            }
+            if (!eptr) {
+                throw std::runtime_error("exception not rethrown by wait");
+            }
+        }
+
         // stop_and_reset()
         {
             ThreadPool pool(2);
@@ -593,6 +2162,9 @@ main()
     std::cout << "* [quickpool] stress tests: queue growth\t\r"
               << std::flush;
     stress_queue_growth_and_reuse();
+    std::cout << "* [quickpool] stress tests: deque growth\t\r"
+              << std::flush;
+    stress_deque_growth_and_stealing();
     std::cout << "* [quickpool] stress tests: concurrent push\t\r"
               << std::flush;
     stress_concurrent_push_and_reuse();